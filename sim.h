@@ -14,8 +14,54 @@ enum CPU_OPCODE_enum {
   STORE,
 };
 
-extern string opcode2String(CPU_OPCODE_enum opcode);
+// Signature of sim_uop() and of the specialized cores which can replace it
+//   (sim_uop_fn of sim_api.h: the opcode is a CPU_OPCODE_enum)
+typedef void (*SIM_UOP_FUNC)(UINT32 opCode, UINT32 src1, UINT32 src2, UINT32 src3, UINT32 dst);
 
-extern std::ofstream TraceFile;
+// Front-end: signature of sim_fetch(), called once per macro-instruction before its uops,
+//   and the fusion flags it is passed (sim_fetch_fn and sim_fused of sim_api.h)
+typedef void (*SIM_FETCH_FUNC)(UINT64 pc, UINT32 size, UINT32 slots, UINT32 fused);
+enum FUSION_enum {
+  FUSED_MACRO   = 1,  // cmp/test fused with the following conditional branch
+  FUSED_LOAD_OP = 2,  // the load of a load+op instruction shares the op's decode slot
+};
+
+// ------------------------- SMT uop queue -----------------------------
+// A micro-op as produced by the instrumentation of one application thread.
+struct SmtUop {
+  UINT32 opCode;
+  UINT32 src1, src2, src3;
+  UINT32 dst;
+};
+
+// Single-producer/single-consumer ring of uops: the application thread pushes,
+//   the simulation thread pops. No locks: the indices are published with acquire/release.
+class SmtQueue {
+  public:
+    SmtQueue(UINT32 _size) : size(_size), head(0), tail(0) { buf = new SmtUop[size]; }
+    ~SmtQueue() { delete [] buf; }
+
+    // Producer side. Returns false if the queue is full.
+    bool push(const SmtUop &uop) {
+      if (tail - __atomic_load_n(&head, __ATOMIC_ACQUIRE) == size)
+        return false;
+      buf[tail & (size - 1)] = uop;
+      __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+    // Consumer side. Returns NULL if the queue is empty.
+    SmtUop *front() {
+      if (head == __atomic_load_n(&tail, __ATOMIC_ACQUIRE))
+        return NULL;
+      return &buf[head & (size - 1)];
+    }
+    void pop() { __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE); }
+
+  private:
+    SmtUop *buf;
+    UINT64  size;   // power of 2
+    UINT64  head;   // written by the consumer only
+    UINT64  tail;   // written by the producer only
+};
 
 #endif
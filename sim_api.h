@@ -0,0 +1,186 @@
+#ifndef SIM_API_H
+#define SIM_API_H
+
+// -------------------------------------------------------------------
+// C API of the timing core (sim_uop.cpp), built as libsimcore without Pin.
+//   sim_pin.cpp is the Pin front-end over it; sim_bench and sim_check drive it
+//   directly, and so can any trace reader or configuration sweep:
+//
+//   sim_config cfg;
+//   sim_config_default(&cfg);
+//   sim_config_set(&cfg, "dispatch_width", "4");      // or cfg.disp_width = 4;
+//   sim_core *core = sim_create(&cfg);                // NULL on error, see sim_last_error()
+//   sim_feed(core, uops, n);                          // as many batches as needed
+//   sim_drain(core);
+//   sim_get_stats(core, &stats);
+//   sim_destroy(core);
+//
+// The core keeps its state in globals, so a process has at most one core at a
+//   time: sim_create() fails while another one exists. Create and destroy one per
+//   configuration to sweep many of them in one process.
+// Only plain C types, so that the interface does not depend on the compiler of the
+//   library. SIM_API_VERSION changes whenever sim_config or sim_stats change.
+// -------------------------------------------------------------------
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIM_API_VERSION 3
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define SIM_API __attribute__((visibility("default")))
+#else
+#define SIM_API
+#endif
+
+// Uop opcodes (the values of CPU_OPCODE_enum in sim.h)
+enum sim_opcode {
+  SIM_OP_MEMOP = 1,  // Functional unit of loads and stores; not a uop opcode
+  SIM_OP_IALU,
+  SIM_OP_IMUL,
+  SIM_OP_IDIV,
+  SIM_OP_FALU,
+  SIM_OP_FMUL,
+  SIM_OP_FDIV,
+  SIM_OP_LOAD = 9,
+  SIM_OP_STORE,
+};
+
+// Fusion flags of sim_fetch()
+enum sim_fused {
+  SIM_FUSED_MACRO   = 1,  // cmp/test fused with the following conditional branch
+  SIM_FUSED_LOAD_OP = 2,  // the load of a load+op instruction shares the op's decode slot
+};
+
+// A uop: opcode and register numbers (0: no register), below sim_config.num_regs
+typedef struct sim_uop_rec {
+  uint32_t opcode;
+  uint32_t src1, src2, src3;
+  uint32_t dst;
+} sim_uop_rec;
+
+// ---------------------------- Configuration --------------------------
+#define SIM_STR_MAX 64
+
+#define SIM_PARAM_FIELD_U32(field)  uint32_t field;
+#define SIM_PARAM_FIELD_U64(field)  uint64_t field;
+#define SIM_PARAM_FIELD_BOOL(field) uint32_t field;
+#define SIM_PARAM_FIELD_STR(field)  char field[SIM_STR_MAX];
+
+// The machine and the simulation control, one field per parameter of sim_params.def
+typedef struct sim_config {
+  uint32_t api_version;   // SIM_API_VERSION, set by sim_config_default()
+  uint32_t num_regs;      // Register numbers of the uops are below this (default 1024)
+#define SIM_PARAM(type, field, name, def, desc) SIM_PARAM_FIELD_##type(field)
+#include "sim_params.def"
+#undef SIM_PARAM
+} sim_config;
+
+// Fill cfg with the default of every parameter (the defaults of the Pin tool's knobs)
+SIM_API void sim_config_default(sim_config *cfg);
+// Set the parameter with the given switch name (as in sim_params.def, without the '-').
+//   Numbers may be decimal or 0x hex, booleans 0/1/true/false.
+//   Returns 0, or -1 if there is no such parameter or the value does not fit.
+SIM_API int  sim_config_set(sim_config *cfg, const char *name, const char *value);
+
+// ------------------------------ Core ---------------------------------
+typedef struct sim_core sim_core;
+
+SIM_API uint32_t    sim_api_version(void);   // SIM_API_VERSION of the library
+// Create the core, selecting the specialized core variant which matches cfg, if any.
+//   Returns NULL if cfg is invalid or a core already exists.
+SIM_API sim_core   *sim_create(const sim_config *cfg);
+// Reason of the last sim_create() failure, or of the last call rejected for a handle
+//   which is not the existing core or for a uop register number not below num_regs.
+//   Rejected calls do nothing and return 0 (NULL; 1 from sim_finished()).
+SIM_API const char *sim_last_error(void);
+SIM_API void        sim_destroy(sim_core *core);
+
+// Simulate n uops in program order. Returns the number simulated: fewer than n
+//   once the detailed cycles are exhausted (see sim_finished()), or up to the first
+//   uop with a register number not below num_regs (see sim_last_error()).
+SIM_API uint64_t sim_feed(sim_core *core, const sim_uop_rec *uops, uint64_t n);
+// Front-end: fetch and decode the macro-instruction at pc, of size bytes, needing slots
+//   decode slots, before its uops are fed. fused holds sim_fused flags.
+SIM_API void     sim_fetch(sim_core *core, uint64_t pc, uint32_t size, uint32_t slots, uint32_t fused);
+// Let cycles clock cycles pass without dispatching anything, e.g. while a trace has no uops
+SIM_API void     sim_advance(sim_core *core, uint64_t cycles);
+// Advance the clock until every uop fed so far has written its result
+SIM_API void     sim_drain(sim_core *core);
+// True once the detailed cycles (sim_config.num_detailed) are exhausted. The core ignores
+//   any further uops. Safe to read from any thread.
+SIM_API int      sim_finished(const sim_core *core);
+
+// Called once when the simulation finishes, on the thread which drove the core past the
+//   last detailed cycle. It may end the process.
+typedef void (*sim_finish_fn)(sim_core *core, void *ctx);
+SIM_API void sim_set_finish_callback(sim_core *core, sim_finish_fn fn, void *ctx);
+
+// Physical register class of the results written to a register (sim_set_reg_class())
+enum sim_reg_class {
+  SIM_REG_BY_OPCODE = 0,  // FP for FALU, FMUL and FDIV results, integer otherwise (default)
+  SIM_REG_INT,
+  SIM_REG_FP,
+};
+// Set the class of register reg (below num_regs), e.g. FP for the vector registers, so
+//   that FP loads take FP physical registers. Returns 0 if reg or reg_class is invalid.
+SIM_API int sim_set_reg_class(sim_core *core, uint32_t reg, uint32_t reg_class);
+
+// Called for every pipeline event when set: stage is 'D' (dispatch), 'E' (execution starts),
+//   'W' (result written) or 'R' (a speculative issue replayed, see sim_config.spec_wakeup);
+//   seq numbers the uops in dispatch order. Used by sim_check.
+typedef void (*sim_event_fn)(uint64_t cycle, char stage, uint64_t seq, void *ctx);
+SIM_API void sim_set_event_hook(sim_core *core, sim_event_fn fn, void *ctx);
+
+// Per-uop entry points of the selected core variant, for callers (the Pin tool) which
+//   cannot afford a batch or the handle. Only valid while the core exists.
+typedef void (*sim_uop_fn)(uint32_t opcode, uint32_t src1, uint32_t src2, uint32_t src3, uint32_t dst);
+typedef void (*sim_fetch_fn)(uint64_t pc, uint32_t size, uint32_t slots, uint32_t fused);
+SIM_API sim_uop_fn   sim_uop_function(sim_core *core);
+// NULL if sim_fetch() has nothing to do: no front-end model, no fusion, or SMT
+SIM_API sim_fetch_fn sim_fetch_function(sim_core *core);
+
+// ------------------------------ SMT ----------------------------------
+// With sim_config.smt > 0 the uops of each hardware thread context are queued with
+//   sim_smt_push() (one producer per thread) and a single thread runs sim_smt_cycle(),
+//   instead of sim_feed(). The finish callback runs on that thread.
+SIM_API uint32_t sim_smt_threads(const sim_core *core);   // 0 without SMT
+// Returns 0 if the queue of thread tid (below sim_smt_threads()) is full, or if tid or
+//   the uop is invalid (see sim_last_error())
+SIM_API int      sim_smt_push(sim_core *core, uint32_t tid, const sim_uop_rec *uop);
+// Simulate one cycle. Returns 0, without advancing the clock, if no uop is queued.
+SIM_API int      sim_smt_cycle(sim_core *core);
+
+// ---------------------------- Statistics ------------------------------
+typedef struct sim_stats {
+  uint64_t    cycles;            // Simulated cycles, including warm-up (the critical path for -core dataflow)
+  uint64_t    measured_cycles;   // Cycles since warm-up ended
+  uint64_t    uops_dispatched;   // After warm-up
+  uint64_t    uops_wb;           // After warm-up
+  double      ipc;               // uops_wb / measured_cycles
+  uint64_t    stall_rs_full;     // Dispatch stall cycles by reason, after warm-up
+  uint64_t    stall_no_preg;
+  uint64_t    stall_frontend;
+  uint64_t    cdb_conflicts;     // Cycles with more results due than CDBs, after warm-up
+  uint64_t    replays;           // Speculative issues replayed, after warm-up
+  double      host_seconds;      // Since sim_create()
+  const char *core;              // Core variant: generic, dataflow, 1w, ...
+  uint32_t    finished;          // sim_finished()
+} sim_stats;
+
+SIM_API void   sim_get_stats(const sim_core *core, sim_stats *stats);
+// The statistics report of the Pin tool's output file, as a string. Like snprintf():
+//   writes at most size bytes including the '\0' and returns the length of the whole report.
+SIM_API size_t sim_format_stats(const sim_core *core, char *buf, size_t size);
+
+// "IALU", "LOAD", ... ("INVALID" for an unknown opcode)
+SIM_API const char *sim_opcode_name(uint32_t opcode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
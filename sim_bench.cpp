@@ -0,0 +1,312 @@
+// -------------------------------------------------------------------
+// Core throughput benchmark
+//
+// Drives the timing core through its C API (sim_api.h) with synthetic
+//   uop streams and reports simulated uops and cycles per host second
+//   for a matrix of num_rs_*, dispatch_width and cdb_width settings.
+//
+// Usage: sim_bench [-n uops] [-w ilp,chain,mix,mem,fp] [-rs 2,8,32] [-disp 1,2,4] [-cdb 1,2,4]
+//                  [-fus N] [-preset 1w,2w,4w,8w] [-core auto,generic,dataflow] [-chain N]
+//                  [-loads %] [-stores %] [-reuse N] [-mix ialu,imul,idiv,falu,fmul,fdiv] [-dump file]
+// -preset runs the machines of the specialized cores (Core_Nw in sim_uop.cpp) instead of
+//   the -rs/-disp/-cdb/-fus matrix. With several -core names every configuration runs on
+//   each of them, and the speedup column compares its uops/host-s with the first.
+// -dump writes the stream of the first selected workload as a sim_check trace instead.
+// -------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+
+#include "sim_api.h"
+
+using namespace std;
+
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+
+// Uop types, indexed as sim_opcode
+enum { MEMOP = SIM_OP_MEMOP, IALU, IMUL, IDIV, FALU, FMUL, FDIV, LAST_FU };
+
+// -------------------------- Workloads ---------------------------------
+struct Workload {
+	string name;
+	UINT32 chain_len;      // Uops in each serial dependency chain (1: all uops independent)
+	UINT32 load_pct;       // Percentage of loads
+	UINT32 store_pct;      // Percentage of stores
+	UINT32 mix[LAST_FU];   // Relative weights of IALU..FDIV for the other uops (index by opcode)
+	UINT32 reuse_dist;     // Destination registers are rewritten every reuse_dist uops
+};
+
+//                                     chain load store    -  mem ialu imul idiv falu fmul fdiv  reuse
+const Workload g_workloads[] = {
+	{ "ilp",   1,   20, 10, { 0, 0, 80,  10,  2,   4,   3,   1 }, 32 },
+	{ "chain", 64,  20, 10, { 0, 0, 80,  10,  2,   4,   3,   1 }, 32 },
+	{ "mix",   4,   25, 10, { 0, 0, 60,  10,  2,   15,  10,  3 }, 16 },
+	{ "mem",   2,   40, 20, { 0, 0, 90,  5,   0,   5,   0,   0 }, 64 },
+	{ "fp",    8,   20, 5,  { 0, 0, 20,  0,   0,   40,  35,  5 }, 32 },
+};
+
+// ------------------------ Machine presets -----------------------------
+// The configurations of the specialized cores; keep them in step with the Core_Nw
+//   typedefs of sim_uop.cpp (sim_bench warns if -core auto does not select the core).
+struct Preset {
+	string name;
+	UINT32 disp, cdb;
+	UINT32 fus[LAST_FU];   // Indexed by FU type, as Workload::mix
+	UINT32 rs[LAST_FU];
+};
+
+//                       disp cdb     -  mem ialu imul idiv falu fmul fdiv        -  mem ialu imul idiv falu fmul fdiv
+const Preset g_presets[] = {
+	{ "1w",  1,   1,   { 0, 1,  1,   1,   1,   1,   1,   1 },  { 0, 1,  1,   1,   1,   1,   1,   1 } },
+	{ "2w",  2,   2,   { 0, 1,  2,   1,   1,   1,   1,   1 },  { 0, 4,  8,   2,   2,   4,   4,   2 } },
+	{ "4w",  4,   4,   { 0, 2,  4,   1,   1,   2,   2,   1 },  { 0, 8,  16,  4,   4,   8,   8,   4 } },
+	{ "8w",  8,   8,   { 0, 4,  6,   2,   1,   4,   4,   1 },  { 0, 32, 48,  8,   4,   32,  32,  8 } },
+};
+
+// Small deterministic generator, so that every run simulates the same streams
+UINT64 g_rand_state;
+UINT32 bench_rand()
+{
+	g_rand_state = g_rand_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (UINT32) (g_rand_state >> 33);
+}
+
+void generate(const Workload &w, UINT32 n, std::vector<sim_uop_rec> &stream)
+{
+	UINT32 alu_total = 0;
+	for (int i = IALU; i < LAST_FU; i++)
+		alu_total += w.mix[i];
+
+	g_rand_state = 12345;
+	stream.clear();
+	UINT32 prev = 0;     // Destination of the previous uop of the current chain
+	UINT32 pos  = 0;     // Position in the current chain
+	for (UINT32 i = 0; i < n; i++) {
+		sim_uop_rec u;
+		UINT32 reg  = 1 + (i % w.reuse_dist);
+		UINT32 rnd  = 1 + bench_rand() % w.reuse_dist;
+		UINT32 link = (pos > 0)? prev : 1 + bench_rand() % w.reuse_dist;
+		UINT32 pct  = bench_rand() % 100;
+
+		if (pct < w.load_pct) {
+			u.opcode = SIM_OP_LOAD;   // address from the chain, as in pointer chasing
+			u.src1 = link; u.src2 = rnd; u.src3 = 0; u.dst = reg;
+		} else if (pct < w.load_pct + w.store_pct) {
+			u.opcode = SIM_OP_STORE;  // data from the chain, address from any register
+			u.src1 = link; u.src2 = rnd; u.src3 = 0; u.dst = 0;
+		} else {
+			UINT32 pick = (alu_total > 0)? bench_rand() % alu_total : 0;
+			int op = IALU;
+			while ((op < FDIV) && (pick >= w.mix[op])) {
+				pick -= w.mix[op];
+				op++;
+			}
+			u.opcode = op;
+			u.src1 = link; u.src2 = rnd; u.src3 = 0; u.dst = reg;
+		}
+		stream.push_back(u);
+		if (u.opcode != SIM_OP_STORE)
+			prev = u.dst;
+		pos = (pos + 1) % w.chain_len;
+	}
+}
+
+// ----------------------------- Main -----------------------------------
+void parse_list(const char *arg, std::vector<UINT32> &list)
+{
+	list.clear();
+	for (const char *p = arg; *p != '\0'; ) {
+		list.push_back((UINT32) strtoul(p, (char **) &p, 0));
+		if (*p == ',')
+			p++;
+		else if (*p != '\0')
+			break;
+	}
+}
+
+double host_seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void parse_names(const char *arg, std::vector<string> &list)
+{
+	list.clear();
+	std::istringstream is(arg);
+	string name;
+	while (std::getline(is, name, ','))
+		list.push_back(name);
+}
+
+// A machine of the benchmark: a preset, or a point of the -rs/-disp/-cdb/-fus matrix
+Preset matrix_point(UINT32 rs, UINT32 disp, UINT32 cdb, UINT32 fus)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "rs%u/d%u/c%u", rs, disp, cdb);
+	Preset m;
+	m.name = name;
+	m.disp = disp;
+	m.cdb  = cdb;
+	for (int i = 0; i < LAST_FU; i++) {
+		m.fus[i] = fus;
+		m.rs[i]  = rs;
+	}
+	return m;
+}
+
+// One configuration: no debugging messages, no warm-up and no limit on the simulated
+//   cycles. Returns false if the core name is not valid.
+bool configure(sim_config &cfg, const Preset &m, const string &core)
+{
+	sim_config_default(&cfg);
+	cfg.verbose      = 0;
+	cfg.num_warmup   = 0;
+	cfg.num_detailed = 1000000000000000ULL;
+	cfg.disp_width   = m.disp;
+	cfg.cdb_width    = m.cdb;
+	cfg.num_mem   = m.fus[MEMOP]; cfg.num_rs_mem  = m.rs[MEMOP];
+	cfg.num_ialus = m.fus[IALU];  cfg.num_rs_ialu = m.rs[IALU];
+	cfg.num_imuls = m.fus[IMUL];  cfg.num_rs_imul = m.rs[IMUL];
+	cfg.num_idivs = m.fus[IDIV];  cfg.num_rs_idiv = m.rs[IDIV];
+	cfg.num_falus = m.fus[FALU];  cfg.num_rs_falu = m.rs[FALU];
+	cfg.num_fmuls = m.fus[FMUL];  cfg.num_rs_fmul = m.rs[FMUL];
+	cfg.num_fdivs = m.fus[FDIV];  cfg.num_rs_fdiv = m.rs[FDIV];
+	return sim_config_set(&cfg, "core", core.c_str()) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	UINT32 n = 1000000;
+	UINT32 fus = 1;
+	std::vector<string> cores(1, "auto"), preset_names;
+	std::vector<UINT32> rs_list, disp_list, cdb_list;
+	parse_list("2,8,32", rs_list);
+	parse_list("1,2,4", disp_list);
+	parse_list("1,2,4", cdb_list);
+	std::vector<Workload> workloads(g_workloads, g_workloads + sizeof(g_workloads) / sizeof(g_workloads[0]));
+	int chain = -1, loads = -1, stores = -1, reuse = -1;  // -chain/-loads/... apply to every selected workload
+	std::vector<UINT32> mix;
+	string dump;
+
+	for (int a = 1; a < argc; a++) {
+		string opt = argv[a];
+		if (a + 1 >= argc) {
+			fprintf(stderr, "sim_bench: missing value for %s\n", opt.c_str());
+			return 1;
+		}
+		const char *val = argv[++a];
+		if (opt == "-n")            n = strtoul(val, NULL, 0);
+		else if (opt == "-fus")     fus = strtoul(val, NULL, 0);
+		else if (opt == "-core")    parse_names(val, cores);
+		else if (opt == "-preset")  parse_names(val, preset_names);
+		else if (opt == "-rs")      parse_list(val, rs_list);
+		else if (opt == "-disp")    parse_list(val, disp_list);
+		else if (opt == "-cdb")     parse_list(val, cdb_list);
+		else if (opt == "-chain")   chain = strtoul(val, NULL, 0);
+		else if (opt == "-loads")   loads = strtoul(val, NULL, 0);
+		else if (opt == "-stores")  stores = strtoul(val, NULL, 0);
+		else if (opt == "-reuse")   reuse = strtoul(val, NULL, 0);
+		else if (opt == "-mix")     parse_list(val, mix);
+		else if (opt == "-dump")    dump = val;
+		else if (opt == "-w") {
+			std::vector<Workload> selected;
+			string names = string(",") + val + ",";
+			for (UINT32 w = 0; w < workloads.size(); w++)
+				if (names.find("," + workloads[w].name + ",") != string::npos)
+					selected.push_back(workloads[w]);
+			workloads = selected;
+		} else {
+			fprintf(stderr, "sim_bench: unknown option %s\n", opt.c_str());
+			return 1;
+		}
+	}
+	for (UINT32 w = 0; w < workloads.size(); w++) {
+		if (chain > 0)   workloads[w].chain_len  = chain;
+		if (loads >= 0)  workloads[w].load_pct   = loads;
+		if (stores >= 0) workloads[w].store_pct  = stores;
+		if (reuse > 0)   workloads[w].reuse_dist = (reuse < 1023)? reuse : 1023;   // Registers below sim_config.num_regs
+		for (UINT32 i = 0; (i < mix.size()) && (IALU + i < LAST_FU); i++)
+			workloads[w].mix[IALU + i] = mix[i];
+	}
+
+	if (!dump.empty()) {
+		std::vector<sim_uop_rec> uops;
+		std::ofstream out(dump.c_str());
+		if (workloads.empty() || !out) {
+			fprintf(stderr, "sim_bench: cannot dump to %s\n", dump.c_str());
+			return 1;
+		}
+		generate(workloads[0], n, uops);
+		out << "# sim_bench workload " << workloads[0].name << ", " << n << " uops" << endl;
+		for (UINT32 i = 0; i < uops.size(); i++)
+			out << sim_opcode_name(uops[i].opcode) << " " << uops[i].src1 << " " << uops[i].src2
+			    << " " << uops[i].src3 << " " << uops[i].dst << endl;
+		return 0;
+	}
+
+	std::vector<Preset> machines;
+	for (UINT32 p = 0; p < preset_names.size(); p++) {
+		UINT32 i = 0;
+		while ((i < sizeof(g_presets) / sizeof(g_presets[0])) && (preset_names[p] != g_presets[i].name))
+			i++;
+		if (i == sizeof(g_presets) / sizeof(g_presets[0])) {
+			fprintf(stderr, "sim_bench: unknown preset %s\n", preset_names[p].c_str());
+			return 1;
+		}
+		machines.push_back(g_presets[i]);
+	}
+	if (machines.empty()) {
+		for (UINT32 r = 0; r < rs_list.size(); r++)
+		for (UINT32 d = 0; d < disp_list.size(); d++)
+		for (UINT32 c = 0; c < cdb_list.size(); c++)
+			machines.push_back(matrix_point(rs_list[r], disp_list[d], cdb_list[c], fus));
+	}
+
+	printf("%-8s %-14s %-8s %12s %6s %14s %14s %8s\n",
+	       "workload", "config", "core", "cycles", "IPC", "uops/host-s", "cycles/host-s", "speedup");
+	std::vector<sim_uop_rec> stream;
+	for (UINT32 w = 0; w < workloads.size(); w++) {
+		generate(workloads[w], n, stream);
+		for (UINT32 m = 0; m < machines.size(); m++) {
+			double base = 0;   // uops/host-s of the first core
+			for (UINT32 k = 0; k < cores.size(); k++) {
+				sim_config cfg;
+				sim_core *sim = configure(cfg, machines[m], cores[k])? sim_create(&cfg) : NULL;
+				if (sim == NULL) {
+					fprintf(stderr, "sim_bench: %s\n", sim_last_error());
+					return 1;
+				}
+				double start = host_seconds();
+				if (!stream.empty())
+					sim_feed(sim, &stream[0], stream.size());
+				sim_drain(sim);   // The cycles include the uops still in flight
+				double secs = host_seconds() - start;
+				if (secs <= 0)
+					secs = 1e-9;
+				sim_stats st;
+				sim_get_stats(sim, &st);
+				double rate = stream.size() / secs;
+				if (k == 0)
+					base = rate;
+				printf("%-8s %-14s %-8s %12llu %6.3f %14.0f %14.0f %7.2fx\n",
+				       workloads[w].name.c_str(), machines[m].name.c_str(), st.core,
+				       (unsigned long long) st.cycles, (st.cycles > 0)? (double) st.uops_wb / st.cycles : 0.0,
+				       rate, st.cycles / secs, (base > 0)? rate / base : 1.0);
+				if ((cores[k] == "auto") && !preset_names.empty() && (machines[m].name != st.core))
+					fprintf(stderr, "sim_bench: preset %s ran on the %s core: out of step with sim_uop.cpp\n",
+					        machines[m].name.c_str(), st.core);
+				fflush(stdout);
+				sim_destroy(sim);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,374 @@
+// -------------------------------------------------------------------
+// Golden-cycle regression checker
+//
+// Runs recorded uop traces through the timing core (its C API, sim_api.h) and
+//   compares the per-cycle dispatch (D), execute (E) and write-result (W)
+//   timeline with a reference:
+//
+// sim_check -record trace.uops         print the golden timeline of the trace
+// sim_check trace.uops ...             compare each trace with trace.golden
+// sim_check -diff [-opt k=v,...] trace.uops ...
+//                                      run the reference core (sim_ref.cpp) and the library
+//                                      core (with the -opt settings, default core=auto) in
+//                                      lockstep on each trace, and report the first
+//                                      divergent cycle. The reference models the base
+//                                      machine only: the trace's settings of later
+//                                      features are dropped for both.
+//
+// Trace format: one uop per line, "OPCODE src1 src2 src3 dst [thread]" (register numbers;
+//   the SMT thread context, default 0, with knob smt), "knob <name> <value>" lines set the
+//   machine configuration, '#' starts a comment.
+// Golden format: "<cycle> <D|E|W> <seq>" lines in cycle order, then "cycles <N>".
+// -------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+#include "sim_api.h"
+#include "sim_ref.h"
+
+using namespace std;
+
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+
+struct Event {
+	UINT64 cycle;
+	char   stage;
+	UINT64 seq;
+	bool operator<(const Event &e) const {
+		if (cycle != e.cycle) return cycle < e.cycle;
+		if (stage != e.stage) return stage < e.stage;
+		return seq < e.seq;
+	}
+	bool operator==(const Event &e) const { return (cycle == e.cycle) && (stage == e.stage) && (seq == e.seq); }
+};
+
+struct Timeline {
+	std::vector<Event> events;   // Sorted by cycle, then stage and sequence number
+	UINT64 cycles;               // Final cycle count after draining the pipeline
+};
+
+struct Trace {
+	std::vector<std::pair<string, string> > knobs;
+	std::vector<sim_uop_rec> uops;
+	std::vector<UINT32> threads;   // SMT thread context of each uop
+};
+
+// Event hook of the core: ctx is the event list being recorded
+void record_event(uint64_t cycle, char stage, uint64_t seq, void *ctx)
+{
+	Event e = { cycle, stage, seq };
+	((std::vector<Event> *) ctx)->push_back(e);
+}
+
+bool load_trace(const string &file, Trace &trace)
+{
+	std::ifstream in(file.c_str());
+	if (!in) {
+		fprintf(stderr, "sim_check: cannot open %s\n", file.c_str());
+		return false;
+	}
+	string line;
+	while (std::getline(in, line)) {
+		std::istringstream is(line.substr(0, line.find('#')));
+		string word;
+		if (!(is >> word))
+			continue;
+		if (word == "knob") {
+			string name, value;
+			is >> name >> value;
+			trace.knobs.push_back(std::make_pair(name, value));
+			continue;
+		}
+		sim_uop_rec u;
+		u.opcode = 0;
+		for (UINT32 op = SIM_OP_IALU; op <= SIM_OP_STORE; op++)
+			if (sim_opcode_name(op) == word)
+				u.opcode = op;
+		UINT32 thread = 0;
+		if ((u.opcode == 0) || !(is >> u.src1 >> u.src2 >> u.src3 >> u.dst) || (!(is >> thread) && !is.eof())) {
+			fprintf(stderr, "sim_check: %s: bad line: %s\n", file.c_str(), line.c_str());
+			return false;
+		}
+		trace.uops.push_back(u);
+		trace.threads.push_back(thread);
+	}
+	return true;
+}
+
+bool load_golden(const string &file, Timeline &golden)
+{
+	std::ifstream in(file.c_str());
+	if (!in) {
+		fprintf(stderr, "sim_check: cannot open %s\n", file.c_str());
+		return false;
+	}
+	string line;
+	golden.cycles = 0;
+	while (std::getline(in, line)) {
+		std::istringstream is(line.substr(0, line.find('#')));
+		string word;
+		if (!(is >> word))
+			continue;
+		if (word == "cycles") {
+			is >> golden.cycles;
+			continue;
+		}
+		Event e;
+		e.cycle = strtoull(word.c_str(), NULL, 0);
+		is >> e.stage >> e.seq;
+		golden.events.push_back(e);
+	}
+	std::sort(golden.events.begin(), golden.events.end());
+	return true;
+}
+
+// Apply "k=v,k=v" knob settings
+bool apply_knobs(sim_config &cfg, const string &settings)
+{
+	std::istringstream is(settings);
+	string kv;
+	while (std::getline(is, kv, ',')) {
+		size_t eq = kv.find('=');
+		if ((eq == string::npos) || (sim_config_set(&cfg, kv.substr(0, eq).c_str(), kv.substr(eq + 1).c_str()) != 0)) {
+			fprintf(stderr, "sim_check: bad knob setting: %s\n", kv.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+// The machine of the trace: no debugging messages, no warm-up and no limit on the
+//   simulated cycles
+bool trace_config(const Trace &trace, sim_config &cfg)
+{
+	sim_config_default(&cfg);
+	cfg.verbose      = 0;
+	cfg.num_warmup   = 0;
+	cfg.num_detailed = 1000000000000000ULL;
+	for (UINT32 k = 0; k < trace.knobs.size(); k++) {
+		if (sim_config_set(&cfg, trace.knobs[k].first.c_str(), trace.knobs[k].second.c_str()) != 0) {
+			fprintf(stderr, "sim_check: bad knob: %s %s\n", trace.knobs[k].first.c_str(), trace.knobs[k].second.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+// Simulate the trace from reset and record its timeline
+bool run(const Trace &trace, const string &settings, Timeline &timeline, string &core_name)
+{
+	sim_config cfg;
+	if (!trace_config(trace, cfg) || !apply_knobs(cfg, settings))
+		return false;
+
+	sim_core *core = sim_create(&cfg);
+	if (core == NULL) {
+		fprintf(stderr, "sim_check: %s\n", sim_last_error());
+		return false;
+	}
+	timeline.events.clear();
+	sim_set_event_hook(core, record_event, &timeline.events);
+	UINT32 threads = sim_smt_threads(core);
+	for (UINT32 i = 0; i < trace.uops.size(); i++) {
+		if (trace.threads[i] >= std::max(threads, (UINT32) 1)) {
+			fprintf(stderr, "sim_check: uop %u: no thread context %u\n", i, trace.threads[i]);
+			sim_destroy(core);
+			return false;
+		}
+	}
+	if (threads > 0) {
+		// SMT: queue the uops of each thread context, simulating cycles whenever a queue is full
+		for (UINT32 i = 0; i < trace.uops.size(); i++) {
+			while (!sim_smt_push(core, trace.threads[i], &trace.uops[i]))
+				sim_smt_cycle(core);
+		}
+		while (sim_smt_cycle(core))
+			;
+	} else if (!trace.uops.empty())
+		sim_feed(core, &trace.uops[0], trace.uops.size());
+	sim_drain(core);
+	sim_stats stats;
+	sim_get_stats(core, &stats);
+	timeline.cycles = stats.cycles;
+	core_name = stats.core;
+	sim_destroy(core);
+	std::sort(timeline.events.begin(), timeline.events.end());
+	return true;
+}
+
+void print_cycle(const char *label, const std::vector<Event> &events, UINT64 cycle)
+{
+	printf("  %s:", label);
+	for (UINT32 i = 0; i < events.size(); i++)
+		if (events[i].cycle == cycle)
+			printf(" %c%llu", events[i].stage, (unsigned long long) events[i].seq);
+	printf("\n");
+}
+
+// Compare the timelines cycle by cycle. Returns true if they are identical.
+bool compare(const string &name, const Timeline &ref, const Timeline &got)
+{
+	UINT32 i = 0;
+	while ((i < ref.events.size()) && (i < got.events.size()) && (ref.events[i] == got.events[i]))
+		i++;
+	if ((i == ref.events.size()) && (i == got.events.size())) {
+		if (ref.cycles == got.cycles)
+			return true;
+		printf("FAIL %s: final cycle count %llu, expected %llu\n", name.c_str(),
+		       (unsigned long long) got.cycles, (unsigned long long) ref.cycles);
+		return false;
+	}
+	// The first divergent cycle is the earlier of the two mismatching events
+	UINT64 cycle;
+	if (i == ref.events.size())
+		cycle = got.events[i].cycle;
+	else if (i == got.events.size())
+		cycle = ref.events[i].cycle;
+	else
+		cycle = std::min(ref.events[i].cycle, got.events[i].cycle);
+	printf("FAIL %s: first divergent cycle %llu\n", name.c_str(), (unsigned long long) cycle);
+	print_cycle("expected", ref.events, cycle);
+	print_cycle("got     ", got.events, cycle);
+	return false;
+}
+
+// The events of timeline from index done on that happened before cycle until, sorted.
+//   Both cores emit their events in cycle order, and the events of a cycle are complete
+//   once the core has moved past it.
+UINT32 settle(std::vector<Event> &events, UINT32 done, UINT64 until)
+{
+	UINT32 end = done;
+	while ((end < events.size()) && (events[end].cycle < until))
+		end++;
+	std::sort(events.begin() + done, events.begin() + end);
+	return end;
+}
+
+// Run the reference and the library core (with the settings) in lockstep, one uop at a
+//   time, and compare every cycle both have completed, up to the first divergence.
+//   Returns false on errors; note names the parameters of the trace the reference does
+//   not model.
+bool lockstep(const string &name, const Trace &trace, const string &settings, bool &same, string &core_name,
+              string &note, UINT64 &cycles)
+{
+	sim_config cfg, base;
+	if (!trace_config(trace, cfg))
+		return false;
+	note = ref_base_config(&cfg, &base);
+	cfg = base;
+	if (!apply_knobs(cfg, settings))
+		return false;
+	sim_core *core = sim_create(&cfg);
+	if (core == NULL) {
+		fprintf(stderr, "sim_check: %s\n", sim_last_error());
+		return false;
+	}
+	Timeline ref, got;
+	sim_set_event_hook(core, record_event, &got.events);
+	ref_create(&base, record_event, &ref.events);
+
+	same = true;
+	UINT32 ref_done = 0, got_done = 0;
+	sim_stats stats;
+	for (UINT32 i = 0; same && (i < trace.uops.size()); i++) {
+		ref_uop(&trace.uops[i]);
+		sim_feed(core, &trace.uops[i], 1);
+		sim_get_stats(core, &stats);
+		UINT64 until = std::min(ref_cycle(), (UINT64) stats.cycles);
+		ref_done = settle(ref.events, ref_done, until);
+		got_done = settle(got.events, got_done, until);
+		same = (ref_done == got_done) && std::equal(ref.events.begin(), ref.events.begin() + ref_done, got.events.begin());
+	}
+	if (same) {
+		ref_drain();
+		sim_drain(core);
+		sim_get_stats(core, &stats);
+		ref_done = settle(ref.events, ref_done, (UINT64) -1);
+		got_done = settle(got.events, got_done, (UINT64) -1);
+	}
+	ref.events.resize(ref_done);
+	got.events.resize(got_done);
+	ref.cycles = ref_cycle();
+	got.cycles = same? stats.cycles : ref.cycles;   // Only the events count before the end
+	cycles = stats.cycles;
+	core_name = stats.core;
+	sim_destroy(core);
+	ref_destroy();
+	same = compare(name, ref, got);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	bool record = false, diff = false;
+	string opt_settings = "core=auto";
+	std::vector<string> files;
+
+	for (int a = 1; a < argc; a++) {
+		string opt = argv[a];
+		if (opt == "-record")
+			record = true;
+		else if (opt == "-diff")
+			diff = true;
+		else if ((opt == "-opt") && (a + 1 < argc))
+			opt_settings = argv[++a];
+		else if (opt[0] == '-') {
+			fprintf(stderr, "sim_check: unknown option %s\n", opt.c_str());
+			return 1;
+		} else
+			files.push_back(opt);
+	}
+	if (files.empty()) {
+		fprintf(stderr, "usage: sim_check [-record | -diff [-opt k=v,...]] trace.uops ...\n");
+		return 1;
+	}
+
+	UINT32 failed = 0;
+	for (UINT32 f = 0; f < files.size(); f++) {
+		Trace trace;
+		Timeline ref, got;
+		string ref_core, got_core;
+		if (!load_trace(files[f], trace))
+			return 1;
+
+		if (record) {
+			if (!run(trace, "", ref, ref_core))
+				return 1;
+			printf("# sim_check golden timeline of %s: <cycle> <stage> <seq>\n", files[f].c_str());
+			for (UINT32 i = 0; i < ref.events.size(); i++)
+				printf("%llu %c %llu\n", (unsigned long long) ref.events[i].cycle, ref.events[i].stage,
+				       (unsigned long long) ref.events[i].seq);
+			printf("cycles %llu\n", (unsigned long long) ref.cycles);
+			continue;
+		}
+
+		if (diff) {
+			bool same;
+			string note;
+			UINT64 cycles;
+			if (!lockstep(files[f], trace, opt_settings, same, got_core, note, cycles))
+				return 1;
+			if (same)
+				printf("PASS %s (reference vs %s core, %llu cycles%s%s)\n", files[f].c_str(), got_core.c_str(),
+				       (unsigned long long) cycles, note.empty()? "" : ", without ", note.c_str());
+			else
+				failed++;
+			continue;
+		}
+		string golden = files[f].substr(0, files[f].rfind('.')) + ".golden";
+		if (!load_golden(golden, ref) || !run(trace, "", got, got_core))
+			return 1;
+		if (compare(files[f], ref, got))
+			printf("PASS %s (golden vs %s core, %llu cycles)\n", files[f].c_str(), got_core.c_str(),
+			       (unsigned long long) got.cycles);
+		else
+			failed++;
+	}
+	return (failed > 0)? 1 : 0;
+}
@@ -42,54 +42,623 @@ END_LEGAL */
 
 
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include <fstream>
 #include <string>
 
 #include <set>
+#include <map>
 #include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sstream>
 #include "pin.H"
 
-#include "sim.h"
+#include "sim_api.h"
 
 
 
 KNOB<bool>   Knob_dissasemble(KNOB_MODE_WRITEONCE, "pintool", "diss", "0",            "enable dissasembly of x86 and micro-instructions");
 KNOB<string> KnobOutputFile(  KNOB_MODE_WRITEONCE, "pintool", "o",    "tomasulo.out", "specify output file name");
+// Region of interest (ROI): when enabled, only the instructions inside the ROI are simulated
+//   (and instrumented). Markers are "xchg rcx,rcx" (start) and "xchg rdx,rdx" (stop).
+KNOB<bool>   Knob_roi_marker( KNOB_MODE_WRITEONCE, "pintool", "roi_marker", "0",      "simulate only between xchg rcx,rcx and xchg rdx,rdx markers");
+KNOB<string> Knob_roi_rtn(    KNOB_MODE_WRITEONCE, "pintool", "roi_rtn",    "",       "simulate only inside calls to this routine");
+// Directory of the persistent decode cache (one file per image). Empty disables it.
+KNOB<string> Knob_dcache(     KNOB_MODE_WRITEONCE, "pintool", "dcache",     "",       "directory for the persistent instruction decode cache");
+// Directory of the result store: a run whose configuration and workload were already
+//   simulated copies the stored statistics instead of running. Empty disables it.
+KNOB<string> Knob_rcache(     KNOB_MODE_WRITEONCE, "pintool", "rcache",     "",       "directory of the simulation result cache");
+
+// Knobs of the timing core: one per parameter of sim_params.def, Knob_<field>
+#define SIM_KNOB_U32  UINT32
+#define SIM_KNOB_U64  UINT64
+#define SIM_KNOB_BOOL bool
+#define SIM_KNOB_STR  string
+#define SIM_PARAM(type, field, name, def, desc) \
+    KNOB<SIM_KNOB_##type> Knob_##field(KNOB_MODE_WRITEONCE, "pintool", name, def, desc);
+#include "sim_params.def"
+#undef SIM_PARAM
 
 std::ofstream TraceFile;
 
 using std::cout;
 
 
-string opcode2String(CPU_OPCODE_enum opcode)
+// The timing core (see sim_api.h), created in main() from the knobs
+sim_core *g_core;
+
+// The per-uop entry of the selected core variant, called directly by the analysis code
+sim_uop_fn g_uop_fn;
+
+// Front-end (see sim_fetch_t()): called before the uops of every instruction when
+//   the front-end is modelled or instructions are fused; NULL otherwise
+sim_fetch_fn g_fetch_fn;
+bool g_fusion = false;
+
+LOCALFUN VOID PrintStats();
+
+// Copy the knob values into the core's configuration. Returns false if one does not fit.
+LOCALFUN BOOL KnobToParam(uint32_t &param, UINT32 value, const char *name) { param = value; return true; }
+LOCALFUN BOOL KnobToParam(uint64_t &param, UINT64 value, const char *name) { param = value; return true; }
+LOCALFUN BOOL KnobToParam(uint32_t &param, bool value, const char *name)   { param = value; return true; }
+LOCALFUN BOOL KnobToParam(char (&param)[SIM_STR_MAX], const string &value, const char *name)
+{
+    if (value.size() >= SIM_STR_MAX) {
+        std::cerr << "SIM: -" << name << " is too long" << std::endl;
+        return false;
+    }
+    strcpy(param, value.c_str());
+    return true;
+}
+
+LOCALFUN BOOL ConfigFromKnobs(sim_config &cfg)
+{
+    sim_config_default(&cfg);
+    cfg.num_regs = REG_LAST;
+    BOOL ok = true;
+#define SIM_PARAM(type, field, name, def, desc) ok = KnobToParam(cfg.field, Knob_##field.Value(), name) && ok;
+#include "sim_params.def"
+#undef SIM_PARAM
+    return ok;
+}
+
+// The physical register class of every Pin register: the x87, XMM and YMM registers,
+//   and the scratch registers which carry the memory operands of FP instructions
+//   (see DecodeIns()), are FP, the others integer
+LOCALFUN VOID SetRegClasses(sim_core *core)
+{
+    for (UINT32 r = 0; r < REG_LAST; r++) {
+        REG reg = (REG) r;
+        BOOL fp = REG_is_fr(reg) || REG_is_xmm(reg) || REG_is_ymm(reg)
+               || (reg == REG_INST_G2) || (reg == REG_INST_G3);
+        sim_set_reg_class(core, r, fp? SIM_REG_FP : SIM_REG_INT);
+    }
+}
+
+// The core has simulated the detailed cycles (sim_finished()): end the simulation
+LOCALFUN VOID SimFinished(sim_core *core, VOID *v)
+{
+    PrintStats();
+    TraceFile.close();
+    PIN_ExitProcess(0);
+}
+
+// SMT: the application threads only queue their uops; a single internal
+//   simulation thread owns the core and drains the queues (see sim_smt_cycle()).
+PIN_THREAD_UID g_sim_thread_uid;
+bool g_smt_stop    = false;  // No more uops will be queued: drain the queues and stop
+bool g_smt_exiting = false;  // Some thread is already ending the process
+
+// Called by an application thread once the simulation thread has finished the detailed cycles.
+LOCALFUN VOID SmtExit()
+{
+    if (__sync_bool_compare_and_swap(&g_smt_exiting, false, true)) {
+        PrintStats();
+        TraceFile.close();
+        PIN_ExitProcess(0);   // end the simulation
+    }
+}
+
+// Analysis routine used instead of sim_uop() in SMT mode.
+LOCALFUN VOID SmtQueueUop(THREADID tid,
+                          UINT32 opCode,
+                          UINT32 src1,
+                          UINT32 src2,
+                          UINT32 src3,
+                          UINT32 dst)
+{
+    if (tid >= sim_smt_threads(g_core))   // More application threads than hardware contexts
+        return;
+    sim_uop_rec uop = { opCode, src1, src2, src3, dst };
+    while (!sim_smt_push(g_core, tid, &uop)) {   // Queue full: let the simulation thread catch up
+        if (sim_finished(g_core))
+            break;
+        PIN_Yield();
+    }
+    if (sim_finished(g_core))
+        SmtExit();
+}
+
+// Body of the internal simulation thread.
+LOCALFUN VOID SmtSimThread(VOID *arg)
+{
+    while (!sim_finished(g_core)) {
+        if (!sim_smt_cycle(g_core)) {   // Nothing queued
+            if (__atomic_load_n(&g_smt_stop, __ATOMIC_ACQUIRE))
+                break;
+            PIN_Yield();
+        }
+    }
+}
+
+// The application is exiting: let the simulation thread drain the queues before Fini prints the stats.
+LOCALFUN VOID SmtPrepareForFini(VOID *v)
+{
+    __atomic_store_n(&g_smt_stop, true, __ATOMIC_RELEASE);
+    PIN_WaitForThreadTermination(g_sim_thread_uid, PIN_INFINITE_TIMEOUT, NULL);
+}
+
+
+// ------------------------- Region of interest -----------------------------
+// The ROI state is process-wide: with SMT a start in any thread opens the ROI of all
+//   threads, and the instances count the cycles and uops of every thread.
+bool     g_roi_enabled = false;  // Simulate only inside the ROI
+INT32    g_roi_depth   = 0;      // Nesting depth of ROI starts (recursive calls of the ROI routine)
+PIN_LOCK g_roi_lock;             // Protects g_roi_depth updates and g_rois (any application thread)
+
+// One entry per ROI instance, for the statistics
+struct RoiRecord {
+    UINT64 start_cycle, start_instr;
+    UINT64 end_cycle, end_instr;
+};
+std::vector<RoiRecord> g_rois;
+
+LOCALFUN VOID RoiBegin()
 {
-    switch(opcode) {
-      case MEMOP:  return "MEMOP";
-      case LOAD:  return "LOAD";
-      case STORE: return "STORE";
-      case IALU:  return "IALU";
-      case IMUL:  return "IMUL";
-      case IDIV:  return "IDIV";
-      case FALU:  return "FALU";
-      case FMUL:  return "FMUL";
-      case FDIV:  return "FDIV";
-      default:    return "INVALID";
+    PIN_GetLock(&g_roi_lock, PIN_ThreadId() + 1);
+    if (g_roi_depth++ != 0) {
+        PIN_ReleaseLock(&g_roi_lock);
+        return;
+    }
+    sim_stats stats;
+    sim_get_stats(g_core, &stats);
+    RoiRecord roi = { stats.cycles, stats.uops_dispatched, 0, 0 };
+    g_rois.push_back(roi);
+    PIN_ReleaseLock(&g_roi_lock);
+    // Instrumentation depends on being inside the ROI: discard the code cache
+    //   so that the code is re-instrumented with uop calls.
+    PIN_RemoveInstrumentation();
+}
+
+LOCALFUN VOID RoiEnd()
+{
+    PIN_GetLock(&g_roi_lock, PIN_ThreadId() + 1);
+    if ((g_roi_depth == 0) || (--g_roi_depth != 0)) {   // A stop marker without a start, or still nested
+        PIN_ReleaseLock(&g_roi_lock);
+        return;
+    }
+    sim_stats stats;
+    sim_get_stats(g_core, &stats);
+    g_rois.back().end_cycle = stats.cycles;
+    g_rois.back().end_instr = stats.uops_dispatched;
+    PIN_ReleaseLock(&g_roi_lock);
+    PIN_RemoveInstrumentation();   // Back to (nearly) native speed
+}
+
+LOCALFUN VOID PrintRoiStats()
+{
+    PIN_GetLock(&g_roi_lock, PIN_ThreadId() + 1);
+    sim_stats stats;
+    sim_get_stats(g_core, &stats);
+    TraceFile << "ROI instances: " << g_rois.size() << endl;
+    for (UINT32 r = 0; r < g_rois.size(); r++) {
+        // An ROI still open at exit ends at the current cycle
+        UINT64 end_cycle = (g_rois[r].end_cycle != 0)? g_rois[r].end_cycle : stats.cycles;
+        UINT64 end_instr = (g_rois[r].end_cycle != 0)? g_rois[r].end_instr : stats.uops_dispatched;
+        TraceFile << "ROI " << r << ": cycles: " << end_cycle - g_rois[r].start_cycle
+                  << " instructions dispatched: " << end_instr - g_rois[r].start_instr << endl;
     }
+    PIN_ReleaseLock(&g_roi_lock);
 }
 
+// The ROI markers are xchg instructions with the same register as both operands
+LOCALFUN BOOL IsRoiMarker(INS ins, REG reg)
+{
+    return (INS_Opcode(ins) == XED_ICLASS_XCHG)
+        && (INS_OperandCount(ins) >= 2)
+        && INS_OperandIsReg(ins, 0) && INS_OperandIsReg(ins, 1)
+        && (REG_FullRegName(INS_OperandReg(ins, 0)) == reg)
+        && (REG_FullRegName(INS_OperandReg(ins, 1)) == reg);
+}
+
+// Instrument the entry and exit of the ROI routine
+LOCALFUN VOID ImageLoad(IMG img, VOID *v)
+{
+    RTN rtn = RTN_FindByName(img, Knob_roi_rtn.Value().c_str());
+    if (!RTN_Valid(rtn))
+        return;
+    RTN_Open(rtn);
+    RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) RoiBegin, IARG_END);
+    RTN_InsertCall(rtn, IPOINT_AFTER,  (AFUNPTR) RoiEnd,   IARG_END);
+    RTN_Close(rtn);
+}
 
-extern void sim_init();
-extern void print_stats();
-extern void sim_uop (CPU_OPCODE_enum opCode,
-                     UINT32 src1,
-                     UINT32 src2,
-                     UINT32 src3,
-                     UINT32 dst);
 
+// ------------------------- Decode cache -----------------------------
+// Instruction() turns every static instruction into a list of uop templates
+//   (the arguments of its sim_uop() calls). With -dcache the templates are kept in one
+//   file per image, keyed by the image path and a checksum of its executable sections,
+//   so that later runs instrument without decoding. Instruction offsets are relative to
+//   the image's low address, so the files survive a different load address (ASLR).
+// The checksum reads all the code of the image, so it is only computed when the size and
+//   modification time of the image file differ from those recorded in the cache file.
+// File layout (mmap-ed read-only): DecodeCacheHeader, DecodeCacheIns[num_ins] sorted by
+//   offset, DecodedUop[num_uops].
+struct DecodedUop {
+    UINT32 opcode;
+    UINT32 src1, src2, src3;
+    UINT32 dst;
+};
+
+struct DecodeCacheHeader {
+    char   magic[8];
+    UINT32 version;
+    UINT32 reg_last;   // REG numbering differs between Pin kits
+    UINT64 checksum;
+    UINT64 img_size;   // Size and modification time (ns) of the image file
+    UINT64 img_mtime;
+    UINT64 num_ins;
+    UINT64 num_uops;
+};
+
+struct DecodeCacheIns {
+    UINT64 offset;
+    UINT32 first_uop;
+    UINT32 num_uops;
+};
+
+const char   DCACHE_MAGIC[8] = { 'T', 'O', 'M', 'D', 'C', 'A', 'C', 'H' };
+const UINT32 DCACHE_VERSION  = 3;   // 3: FP memory operands in REG_INST_G2/G3
+
+// Decode cache state of one loaded image
+struct ImageDecodeCache {
+    string  path;
+    string  file;       // The cache file of this image
+    ADDRINT low, high;  // Address range of the image in this run
+    UINT64  checksum;
+    UINT64  img_size, img_mtime;   // Of the image file (0: not a file)
+    bool    restamp;                // The cache file records another size/mtime: rewrite it
+
+    // The cache file as loaded at image load (NULL if there was none)
+    VOID                    *map;
+    size_t                   map_size;
+    const DecodeCacheIns    *ins;
+    const DecodedUop        *uops;
+    UINT64                   num_ins;
+
+    // Instructions decoded in this run, to be added to the file
+    std::map<UINT64, std::vector<DecodedUop> > added;
+};
+
+std::vector<ImageDecodeCache *> g_dcache_images;
+ImageDecodeCache *g_dcache_last = NULL;   // Image of the previous lookup
+
+// Instrumentation statistics
+double g_instrument_secs = 0;
+UINT64 g_ins_decoded = 0, g_ins_cached = 0;
+
+LOCALFUN UINT64 Fnv1a(const UINT8 *data, size_t len, UINT64 hash)
+{
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    return hash;
+}
 
+// A temporary name for writing file, unique among concurrent runs and the threads of
+//   this one, to be renamed to file once complete
+LOCALFUN string TempName(const string &file)
+{
+    static UINT32 count = 0;
+    std::ostringstream name;
+    name << file << "." << getpid() << "." << __sync_fetch_and_add(&count, 1) << ".tmp";
+    return name.str();
+}
+
+LOCALFUN double HostSeconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Write the cached and the newly decoded instructions of an image to its cache file
+LOCALFUN VOID DecodeCacheSave(ImageDecodeCache *dc)
+{
+    if (dc->added.empty() && !dc->restamp)
+        return;
+    std::map<UINT64, std::vector<DecodedUop> > all;
+    for (UINT64 i = 0; i < dc->num_ins; i++)
+        all[dc->ins[i].offset].assign(dc->uops + dc->ins[i].first_uop,
+                                      dc->uops + dc->ins[i].first_uop + dc->ins[i].num_uops);
+    for (std::map<UINT64, std::vector<DecodedUop> >::iterator it = dc->added.begin(); it != dc->added.end(); it++)
+        all[it->first] = it->second;
+
+    DecodeCacheHeader hdr;
+    memcpy(hdr.magic, DCACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version  = DCACHE_VERSION;
+    hdr.reg_last = REG_LAST;
+    hdr.checksum = dc->checksum;
+    hdr.img_size  = dc->img_size;
+    hdr.img_mtime = dc->img_mtime;
+    hdr.num_ins  = all.size();
+    hdr.num_uops = 0;
+    std::vector<DecodeCacheIns> ins;
+    std::vector<DecodedUop> uops;
+    for (std::map<UINT64, std::vector<DecodedUop> >::iterator it = all.begin(); it != all.end(); it++) {
+        DecodeCacheIns entry = { it->first, (UINT32) uops.size(), (UINT32) it->second.size() };
+        ins.push_back(entry);
+        uops.insert(uops.end(), it->second.begin(), it->second.end());
+    }
+    hdr.num_uops = uops.size();
+
+    // Write a temporary file and rename it, so that concurrent runs never see a partial file
+    string tmp = TempName(dc->file);
+    std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+    out.write((const char *) &hdr, sizeof(hdr));
+    if (!ins.empty())
+        out.write((const char *) &ins[0], ins.size() * sizeof(DecodeCacheIns));
+    if (!uops.empty())
+        out.write((const char *) &uops[0], uops.size() * sizeof(DecodedUop));
+    out.close();
+    if (out.fail() || (rename(tmp.c_str(), dc->file.c_str()) != 0))
+        unlink(tmp.c_str());
+    dc->added.clear();
+    dc->restamp = false;
+}
+
+// The checksum covers the code, which is all the decoding depends on
+LOCALFUN UINT64 DecodeCacheChecksum(IMG img, ImageDecodeCache *dc)
+{
+    if (dc->checksum == 0) {
+        dc->checksum = 14695981039346656037ULL;
+        for (SEC sec = IMG_SecHead(img); SEC_Valid(sec); sec = SEC_Next(sec))
+            if (SEC_IsExecutable(sec) && SEC_Mapped(sec))
+                dc->checksum = Fnv1a((const UINT8 *) SEC_Address(sec), SEC_Size(sec), dc->checksum);
+    }
+    return dc->checksum;
+}
+
+// Open the decode cache of a newly loaded image
+LOCALFUN VOID DecodeCacheLoad(IMG img)
+{
+    ImageDecodeCache *dc = new ImageDecodeCache;
+    dc->path = IMG_Name(img);
+    dc->low  = IMG_LowAddress(img);
+    dc->high = IMG_HighAddress(img);
+    dc->map  = NULL;
+    dc->map_size = 0;
+    dc->ins  = NULL;
+    dc->uops = NULL;
+    dc->num_ins = 0;
+
+    struct stat img_st;
+    dc->img_size  = 0;
+    dc->img_mtime = 0;
+    if (stat(dc->path.c_str(), &img_st) == 0) {
+        dc->img_size  = img_st.st_size;
+        dc->img_mtime = img_st.st_mtim.tv_sec * 1000000000ULL + img_st.st_mtim.tv_nsec;
+    }
+    dc->checksum = 0;   // Not computed yet
+    dc->restamp  = false;
+
+    string base = dc->path.substr(dc->path.rfind('/') + 1);
+    char key[32];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long) Fnv1a((const UINT8 *) dc->path.c_str(), dc->path.size(), 14695981039346656037ULL));
+    dc->file = Knob_dcache.Value() + "/" + base + "." + key + ".dcache";
+    g_dcache_images.push_back(dc);
+
+    int fd = open(dc->file.c_str(), O_RDONLY);
+    if (fd < 0) {   // The new cache file needs the checksum
+        DecodeCacheChecksum(img, dc);
+        return;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) == 0) && ((size_t) st.st_size >= sizeof(DecodeCacheHeader))) {
+        VOID *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            const DecodeCacheHeader *hdr = (const DecodeCacheHeader *) map;
+            size_t expected = sizeof(DecodeCacheHeader) + hdr->num_ins * sizeof(DecodeCacheIns)
+                            + hdr->num_uops * sizeof(DecodedUop);
+            bool valid = (memcmp(hdr->magic, DCACHE_MAGIC, sizeof(hdr->magic)) == 0)
+                      && (hdr->version == DCACHE_VERSION) && (hdr->reg_last == (UINT32) REG_LAST)
+                      && ((size_t) st.st_size == expected);
+            if (valid && ((dc->img_size == 0) || (hdr->img_size != dc->img_size) || (hdr->img_mtime != dc->img_mtime))) {
+                valid = (hdr->checksum == DecodeCacheChecksum(img, dc));   // The file changed: check its code
+                dc->restamp = valid && (dc->img_size != 0);
+            }
+            if (valid) {
+                dc->checksum = hdr->checksum;
+                dc->map      = map;
+                dc->map_size = st.st_size;
+                dc->num_ins  = hdr->num_ins;
+                dc->ins      = (const DecodeCacheIns *) (hdr + 1);
+                dc->uops     = (const DecodedUop *) (dc->ins + dc->num_ins);
+            } else {   // Stale (the image changed) or foreign: rebuild it
+                munmap(map, st.st_size);
+            }
+        }
+    }
+    close(fd);
+    if (dc->map == NULL)   // The new cache file needs the checksum
+        DecodeCacheChecksum(img, dc);
+}
+
+LOCALFUN VOID DecodeCacheUnload(IMG img)
+{
+    for (UINT32 i = 0; i < g_dcache_images.size(); i++) {
+        ImageDecodeCache *dc = g_dcache_images[i];
+        if (dc->low != IMG_LowAddress(img))
+            continue;
+        DecodeCacheSave(dc);
+        if (dc->map != NULL)
+            munmap(dc->map, dc->map_size);
+        g_dcache_images.erase(g_dcache_images.begin() + i);
+        if (g_dcache_last == dc)
+            g_dcache_last = NULL;
+        delete dc;
+        return;
+    }
+}
+
+LOCALFUN ImageDecodeCache *DecodeCacheFind(ADDRINT addr)
+{
+    if ((g_dcache_last != NULL) && (addr >= g_dcache_last->low) && (addr <= g_dcache_last->high))
+        return g_dcache_last;
+    for (UINT32 i = 0; i < g_dcache_images.size(); i++) {
+        if ((addr >= g_dcache_images[i]->low) && (addr <= g_dcache_images[i]->high)) {
+            g_dcache_last = g_dcache_images[i];
+            return g_dcache_last;
+        }
+    }
+    return NULL;
+}
+
+// Look up the uop templates of the instruction at addr in the cache file (binary search)
+LOCALFUN BOOL DecodeCacheLookup(ImageDecodeCache *dc, ADDRINT addr, std::vector<DecodedUop> &uops)
+{
+    UINT64 offset = addr - dc->low;
+    UINT64 lo = 0, hi = dc->num_ins;
+    while (lo < hi) {
+        UINT64 mid = (lo + hi) / 2;
+        if (dc->ins[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if ((lo == dc->num_ins) || (dc->ins[lo].offset != offset))
+        return false;
+    uops.assign(dc->uops + dc->ins[lo].first_uop, dc->uops + dc->ins[lo].first_uop + dc->ins[lo].num_uops);
+    return true;
+}
+
+// ------------------------- Result cache -----------------------------
+// Entries are <rcache>/<key>.stats, where key is a hash of every knob value (except
+//   the ones which do not change the results), the application command line, the size
+//   and modification time of the application binary and the build of this tool.
+// An entry holds '#' header lines describing the key, a blank line, then the statistics report (PrintStats()).
+// Use sim_rcache to list and prune the store.
+string g_rcache_key;       // Empty if the result cache is disabled
+string g_rcache_header;
+
+// Knobs which do not affect the simulated results. A run with -pipeview must simulate to
+//   write its log, so it stores its statistics but does not look them up.
+const char *RCACHE_IGNORED_KNOBS[] = { "o", "rcache", "dcache", "diss", "verb", "telemetry", "telemetry_interval",
+                                       "pipeview", "pipeview_sample", "pipeview_start", "pipeview_end" };
+
+// Build the key of this run. app_argv is the application command line (after "--").
+LOCALFUN VOID ResultCacheKey(int app_argc, char *app_argv[])
+{
+    std::ostringstream key_text;
+    key_text << "build " << __DATE__ << " " << __TIME__ << "\n";
+
+    // Knob values, one per line in the summary. Ignored knobs are dropped by name.
+    std::istringstream summary(KNOB_BASE::StringKnobSummary());
+    string line;
+    while (std::getline(summary, line)) {
+        std::istringstream is(line);
+        string name;
+        is >> name;
+        size_t first = name.find_first_not_of('-');
+        if (first != string::npos)
+            name = name.substr(first);
+        bool ignored = false;
+        for (UINT32 k = 0; k < sizeof(RCACHE_IGNORED_KNOBS) / sizeof(RCACHE_IGNORED_KNOBS[0]); k++)
+            ignored = ignored || (name == RCACHE_IGNORED_KNOBS[k]);
+        if (!ignored)
+            key_text << line << "\n";
+    }
+
+    std::ostringstream workload;
+    for (int a = 0; a < app_argc; a++)
+        workload << ((a > 0)? " " : "") << app_argv[a];
+    struct stat st;
+    if ((app_argc > 0) && (stat(app_argv[0], &st) == 0))
+        key_text << "binary " << st.st_size << " " << st.st_mtime << "\n";
+    key_text << "workload " << workload.str() << "\n";
+
+    string text = key_text.str();
+    char key[32];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long) Fnv1a((const UINT8 *) text.c_str(), text.size(), 14695981039346656037ULL));
+    g_rcache_key = key;
+    time_t now = time(NULL);
+    g_rcache_header = "# key: " + g_rcache_key + "\n# workload: " + workload.str() + "\n# created: " + ctime(&now);
+}
+
+// Copy the stored statistics of this key to the output file. Returns false on a miss.
+LOCALFUN BOOL ResultCacheLookup()
+{
+    std::ifstream in((Knob_rcache.Value() + "/" + g_rcache_key + ".stats").c_str());
+    if (!in)
+        return false;
+    string line;
+    while (std::getline(in, line) && !line.empty())   // Skip the header
+        ;
+    TraceFile << in.rdbuf();
+    return true;
+}
+
+// Store the statistics of a completed run (the output file, already closed)
+LOCALFUN VOID ResultCacheStore()
+{
+    std::ifstream in(KnobOutputFile.Value().c_str());
+    string entry = Knob_rcache.Value() + "/" + g_rcache_key + ".stats";
+    string tmp = TempName(entry);
+    std::ofstream out(tmp.c_str(), std::ios::trunc);
+    out << g_rcache_header << "\n" << in.rdbuf();
+    out.close();
+    if (out.fail() || (rename(tmp.c_str(), entry.c_str()) != 0))
+        unlink(tmp.c_str());
+}
+
+// Appended to the statistics of the core
+LOCALFUN VOID PrintToolStats()
+{
+    if (g_roi_enabled)
+        PrintRoiStats();
+    TraceFile << "Instrumentation seconds: " << g_instrument_secs << endl;
+    TraceFile << "Static instructions decoded: " << g_ins_decoded
+              << " from decode cache: " << g_ins_cached << endl;
+}
+
+// Write the statistics of the core and of the tool to the output file
+LOCALFUN VOID PrintStats()
+{
+    std::vector<char> text(sim_format_stats(g_core, NULL, 0) + 1);
+    sim_format_stats(g_core, &text[0], text.size());
+    TraceFile << &text[0];
+    PrintToolStats();
+}
+
+// Called for every image: decode cache and ROI routine lookup
+LOCALFUN VOID ImageLoadAll(IMG img, VOID *v)
+{
+    if (!Knob_dcache.Value().empty())
+        DecodeCacheLoad(img);
+    if (!Knob_roi_rtn.Value().empty())
+        ImageLoad(img, v);
+}
+
+LOCALFUN VOID ImageUnload(IMG img, VOID *v)
+{
+    DecodeCacheUnload(img);
+}
 
-extern UINT64 g_instructions_dispatched, g_instructions_wb;
 
 LOCALFUN VOID Fini(int code, VOID * v)
 {
@@ -101,14 +670,40 @@ LOCALFUN VOID Fini(int code, VOID * v)
         g_instructions_dispatched--;
     }
    */
-   print_stats();
+   for (UINT32 i = 0; i < g_dcache_images.size(); i++)
+       DecodeCacheSave(g_dcache_images[i]);
+   PrintStats();
    TraceFile.close();
+   if (!g_rcache_key.empty())
+       ResultCacheStore();
+   sim_destroy(g_core);
 }
 
 
-// Pin instrumentation function. 
+// Insert the analysis call which simulates one micro-op of ins.
+LOCALFUN VOID InsertUop(INS ins, UINT32 opcode, REG src1, REG src2, REG src3, REG dst)
+{
+    if (sim_smt_threads(g_core) == 0)
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) g_uop_fn,
+                       IARG_UINT32, opcode,
+                       IARG_UINT32, src1,
+                       IARG_UINT32, src2,
+                       IARG_UINT32, src3,
+                       IARG_UINT32, dst, IARG_END);
+    else
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) SmtQueueUop,
+                       IARG_THREAD_ID,
+                       IARG_UINT32, opcode,
+                       IARG_UINT32, src1,
+                       IARG_UINT32, src2,
+                       IARG_UINT32, src3,
+                       IARG_UINT32, dst, IARG_END);
+}
+
+
+// Decode an instruction into the micro-ops simulated for it, in order.
 //
-LOCALFUN VOID Instruction(INS ins, VOID *v)
+LOCALFUN VOID DecodeIns(INS ins, std::vector<DecodedUop> &uops)
 {
     // Exclude any weird instructions. 
     // Flow control instructions just honour their dependencies, they do not change the flow
@@ -129,8 +724,15 @@ LOCALFUN VOID Instruction(INS ins, VOID *v)
         cout << INS_Disassemble(ins) << endl;
 
     bool is_fp = false;    // Not a floating point instruction
+    for (UINT32 opIdx = 0; opIdx < INS_OperandCount(ins); opIdx++)
+        if (!INS_OperandIsMemory(ins, opIdx) && REG_is_fr(REG_FullRegName(INS_OperandReg(ins, opIdx))))
+            is_fp = true;
+    // The loaded value and the value to store travel in a scratch register of the
+    //   instruction's class (see SetRegClasses()), so FP loads take FP physical registers
+    REG loadReg  = is_fp? REG_INST_G2 : REG_INST_G0;
+    REG storeReg = is_fp? REG_INST_G3 : REG_INST_G1;
 	bool foundMemRead = false;
-    CPU_OPCODE_enum opcode;
+    UINT32 opcode;   // sim_opcode
     // ------------------- Loads ---------------------------------- 
     // If there is a load, it must be the first micro-op.
     //   If the macro-instr contains more loads, only the first is used.
@@ -140,15 +742,11 @@ LOCALFUN VOID Instruction(INS ins, VOID *v)
             //    even if they are not needed by a specific load, it will be needed by the (macro) instruction
             //      so no harm is done.
             foundMemRead = true;
-            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) sim_uop,
-                           IARG_UINT32, LOAD,
-                           IARG_UINT32, baseReg,
-                           IARG_UINT32, indexReg,
-                           IARG_UINT32, REG_INVALID(),
-                           // Use dummy register to return loaded value to main uOp
-                           IARG_UINT32, REG_INST_G0, IARG_END);
+            // Use dummy register to return loaded value to main uOp
+            DecodedUop uop = { SIM_OP_LOAD, baseReg, indexReg, REG_INVALID(), loadReg };
+            uops.push_back(uop);
             if (Knob_dissasemble.Value())
-                cout << " -> LOAD " << REG_StringShort(REG_INST_G0) << " = *( "
+                cout << " -> LOAD " << REG_StringShort(loadReg) << " = *( "
                      << REG_StringShort(baseReg) << " + " << REG_StringShort(indexReg) << " )" << endl;
         }
     }
@@ -157,14 +755,11 @@ LOCALFUN VOID Instruction(INS ins, VOID *v)
     std::vector<REG> src, dst;
 
     if (foundMemRead == true)   // Add implicit source - from the load uOp
-        src.push_back(REG_INST_G0);
+        src.push_back(loadReg);
 
     for (UINT32 opIdx = 0; opIdx < INS_OperandCount(ins); opIdx++) {
         if (!INS_OperandIsMemory(ins, opIdx)) { 
             REG reg = REG_FullRegName(INS_OperandReg(ins, opIdx));
-            if (REG_is_fr(reg))
-                is_fp = true;
-
             if (INS_OperandRead(ins, opIdx)
             && REG_valid(reg)
             && (reg != baseReg)
@@ -182,30 +777,26 @@ LOCALFUN VOID Instruction(INS ins, VOID *v)
         }
     }
     if (INS_IsMemoryWrite(ins))
-        dst.push_back(REG_INST_G1);  // Implicit destination to be picked up by the store uOp
+        dst.push_back(storeReg);  // Implicit destination to be picked up by the store uOp
 
     // Fill the 3 first elements of src with REG_INVALID, if any are empty
     src.insert(src.end(), (src.size() >= 3)? 0:3-src.size() , REG_INVALID());
 
     // Decode main opcode
     if (OPCODE_StringShort(INS_Opcode(ins)).find("MUL") != string::npos) {
-        opcode = is_fp? FMUL : IMUL;
+        opcode = is_fp? SIM_OP_FMUL : SIM_OP_IMUL;
     } else if (OPCODE_StringShort(INS_Opcode(ins)).find("DIV") != string::npos) {
-        opcode = is_fp? FDIV : IDIV;
+        opcode = is_fp? SIM_OP_FDIV : SIM_OP_IDIV;
     } else {
-        opcode = is_fp? FALU : IALU;
+        opcode = is_fp? SIM_OP_FALU : SIM_OP_IALU;
     }
     // There can be many destinations
     //    e.g. stack POP instructions return the data on the stack and update the stack pointer register
     for (std::vector<REG>::iterator it=dst.begin(); it != dst.end(); it++)  {
-        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) sim_uop,
-                       IARG_UINT32, opcode,
-                       IARG_UINT32, src[0],
-                       IARG_UINT32, src[1],
-                       IARG_UINT32, src[2],
-                       IARG_UINT32, *it, IARG_END);
+        DecodedUop uop = { opcode, src[0], src[1], src[2], *it };
+        uops.push_back(uop);
         if (Knob_dissasemble.Value())
-            cout << " -> " << opcode2String(opcode)   << " " << REG_StringShort(*it)
+            cout << " -> " << sim_opcode_name(opcode)   << " " << REG_StringShort(*it)
                  << " = "  << REG_StringShort(src[0]) << "|" << REG_StringShort(src[1])
                  << "|  "  << REG_StringShort(src[2]) << endl;
     }
@@ -214,38 +805,144 @@ LOCALFUN VOID Instruction(INS ins, VOID *v)
     for (UINT32 memOpIdx = 0; memOpIdx < INS_MemoryOperandCount(ins); memOpIdx++) {
         if (INS_MemoryOperandIsWritten(ins, memOpIdx)) {
             // Assume all stores use both source registers (base, index)
-            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) sim_uop,
-                           IARG_UINT32, STORE,
-                           IARG_UINT32, REG_INST_G1,
-                           IARG_UINT32, baseReg,
-                           IARG_UINT32, indexReg,
-                           IARG_UINT32, REG_INVALID(),
-                           IARG_END);
+            DecodedUop uop = { SIM_OP_STORE, storeReg, baseReg, indexReg, REG_INVALID() };
+            uops.push_back(uop);
             if (Knob_dissasemble.Value())
               cout << " -> STORE *( " <<  REG_StringShort(baseReg) << " + "
-                   << REG_StringShort(indexReg) << ") =" << REG_StringShort(REG_INST_G1) << endl;
+                   << REG_StringShort(indexReg) << ") =" << REG_StringShort(storeReg) << endl;
             break;  // There should only be at most 1 store uop
         }
     }
 }
 
 
+// Macro-op fusion: a cmp or test immediately followed by a conditional branch
+LOCALFUN BOOL IsMacroFusedPair(INS cmp, INS jcc)
+{
+    return INS_Valid(cmp) && INS_Valid(jcc)
+        && ((INS_Opcode(cmp) == XED_ICLASS_CMP) || (INS_Opcode(cmp) == XED_ICLASS_TEST))
+        && (INS_Category(jcc) == XED_CATEGORY_COND_BR);
+}
+
+
+// Pin instrumentation function. 
+//
+LOCALFUN VOID Instruction(INS ins, VOID *v)
+{
+    if (g_roi_enabled) {
+        if (Knob_roi_marker.Value() && IsRoiMarker(ins, REG_GCX)) {
+            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) RoiBegin, IARG_END);
+            return;
+        }
+        if (Knob_roi_marker.Value() && IsRoiMarker(ins, REG_GDX)) {
+            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) RoiEnd, IARG_END);
+            return;
+        }
+        if (g_roi_depth == 0)   // Outside the ROI: leave the code uninstrumented
+            return;
+    }
+
+    // The uop of a fused branch is executed by the compare before it
+    if (g_fusion && INS_Valid(INS_Prev(ins)) && IsMacroFusedPair(INS_Prev(ins), ins))
+        return;
+
+    double start = HostSeconds();
+    std::vector<DecodedUop> uops;
+    // The disassembly is printed while decoding, so -diss always decodes
+    ImageDecodeCache *dc = (Knob_dcache.Value().empty() || Knob_dissasemble.Value())? NULL : DecodeCacheFind(INS_Address(ins));
+    if ((dc != NULL) && DecodeCacheLookup(dc, INS_Address(ins), uops)) {
+        g_ins_cached++;
+    } else {
+        DecodeIns(ins, uops);
+        g_ins_decoded++;
+        if (dc != NULL)
+            dc->added[INS_Address(ins) - dc->low] = uops;
+    }
+    if ((g_fetch_fn != NULL) && !uops.empty()) {
+        UINT32 size  = INS_Size(ins);
+        UINT32 slots = uops.size();
+        UINT32 fused = 0;
+        if (g_fusion && IsMacroFusedPair(ins, INS_Next(ins))) {
+            size  += INS_Size(INS_Next(ins));
+            fused |= SIM_FUSED_MACRO;
+        }
+        if (g_fusion && (uops.size() >= 2) && (uops[0].opcode == SIM_OP_LOAD) && (uops[1].opcode != SIM_OP_STORE)) {
+            slots--;
+            fused |= SIM_FUSED_LOAD_OP;
+        }
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) g_fetch_fn,
+                       IARG_ADDRINT, INS_Address(ins),
+                       IARG_UINT32, size,
+                       IARG_UINT32, slots,
+                       IARG_UINT32, fused, IARG_END);
+    }
+    for (UINT32 i = 0; i < uops.size(); i++)
+        InsertUop(ins, uops[i].opcode, (REG) uops[i].src1, (REG) uops[i].src2,
+                  (REG) uops[i].src3, (REG) uops[i].dst);
+    g_instrument_secs += HostSeconds() - start;
+}
+
+
 
 
 
 int main(int argc, char *argv[])
 {
 
+    PIN_InitSymbols();   // RTN_FindByName() needs the symbol tables
     PIN_Init(argc, argv);
+    PIN_InitLock(&g_roi_lock);
 
     // Write to a file since cout and cerr maybe closed by the application
     TraceFile.open(KnobOutputFile.Value().c_str());
 
+    if (!Knob_rcache.Value().empty()) {
+        int app = 1;   // The application command line follows "--"
+        while ((app < argc) && (string(argv[app]) != "--"))
+            app++;
+        app++;
+        ResultCacheKey((app < argc)? argc - app : 0, argv + app);
+        if (Knob_pipeview.Value().empty() && ResultCacheLookup()) {
+            cout << "SIM: result cache hit " << g_rcache_key << ", application not run" << endl;
+            TraceFile.close();
+            PIN_ExitProcess(0);
+        }
+    }
+
     INS_AddInstrumentFunction(Instruction, 0);
+    g_roi_enabled = Knob_roi_marker.Value() || !Knob_roi_rtn.Value().empty();
+    if (!Knob_roi_rtn.Value().empty() || !Knob_dcache.Value().empty())
+        IMG_AddInstrumentFunction(ImageLoadAll, 0);
+    if (!Knob_dcache.Value().empty())
+        IMG_AddUnloadFunction(ImageUnload, 0);
     PIN_AddFiniFunction(Fini, 0);
 
 
-    sim_init();  // Initialise simulator globals and data structures
+    // Create the timing core from the knobs
+    sim_config cfg;
+    if (!ConfigFromKnobs(cfg))
+        PIN_ExitProcess(1);
+    g_core = sim_create(&cfg);
+    if (g_core == NULL) {
+        std::cerr << "SIM: " << sim_last_error() << std::endl;
+        PIN_ExitProcess(1);
+    }
+    SetRegClasses(g_core);
+    g_uop_fn   = sim_uop_function(g_core);
+    g_fetch_fn = sim_fetch_function(g_core);
+    // The SMT queues carry no front-end information, so fusion is not modelled there
+    g_fusion   = Knob_fusion.Value() && (sim_smt_threads(g_core) == 0);
+    if (Knob_fusion.Value() && !g_fusion)
+        std::cerr << "SIM: -fusion is ignored with -smt" << std::endl;
+    if (sim_smt_threads(g_core) == 0) {
+        sim_set_finish_callback(g_core, SimFinished, 0);
+    } else {
+        PIN_AddPrepareForFiniFunction(SmtPrepareForFini, 0);
+        if (PIN_SpawnInternalThread(SmtSimThread, NULL, 0, &g_sim_thread_uid) == INVALID_THREADID) {
+            std::cerr << "SIM: cannot create the SMT simulation thread" << std::endl;
+            return 1;
+        }
+    }
     PIN_StartProgram();
     // Never returns  
 
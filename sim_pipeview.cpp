@@ -0,0 +1,130 @@
+// -------------------------------------------------------------------
+// Convert a pipeline log (see -pipeview in sim_uop.cpp) to gem5's O3PipeView text,
+//   in program order, for Konata or gem5's util/o3-pipeview.py
+//
+// sim_pipeview <log> [-o file] [-ticks N]   N ticks per cycle (default 1000, as gem5's
+//                                           o3-pipeview.py assumes)
+//
+// The stages are: fetch/decode when the uop reached dispatch, rename/dispatch when it got a
+//   reservation station, issue, complete when its result was due and retire when it was
+//   written on a CDB. The text of each uop gives its registers, FU and dispatch stall.
+// -------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "sim_api.h"
+#include "sim_pipeview.h"
+
+void usage()
+{
+	fprintf(stderr, "usage: sim_pipeview <log> [-o file] [-ticks ticks_per_cycle]\n");
+	exit(1);
+}
+
+bool by_seq(const SimPipeviewRec &a, const SimPipeviewRec &b)
+{
+	return a.seq < b.seq;
+}
+
+// "IALU r3 <- r1,r2 [IALU.0]", with the dispatch stall if the uop waited
+std::string describe(const SimPipeviewRec &r)
+{
+	static const char *stalls[] = { "", "RS full", "no physical register", "front-end" };
+	char buf[160];
+	std::string s = sim_opcode_name(r.opcode);
+	if ((r.opcode != SIM_OP_STORE) && (r.dst != 0)) {
+		snprintf(buf, sizeof(buf), " r%u <-", r.dst);
+		s += buf;
+	}
+	const uint32_t srcs[3] = { r.src1, r.src2, r.src3 };
+	const char *sep = " ";
+	for (int i = 0; i < 3; i++) {
+		if (srcs[i] == 0)
+			continue;
+		snprintf(buf, sizeof(buf), "%sr%u", sep, srcs[i]);
+		s += buf;
+		sep = ",";
+	}
+	const char *fu = sim_opcode_name(((r.opcode == SIM_OP_LOAD) || (r.opcode == SIM_OP_STORE))? (uint32_t) SIM_OP_MEMOP : r.opcode);
+	snprintf(buf, sizeof(buf), " [%s.%u", fu, r.fu_num);
+	s += buf;
+	if (r.cluster > 0) {
+		snprintf(buf, sizeof(buf), " cluster %u", r.cluster);
+		s += buf;
+	}
+	if (r.tid > 0) {
+		snprintf(buf, sizeof(buf), " thread %u", r.tid);
+		s += buf;
+	}
+	s += "]";
+	if (r.replays > 0)
+		s += " replayed";
+	if ((r.stall_cycles > 0) && (r.stall < sizeof(stalls) / sizeof(stalls[0]))) {
+		snprintf(buf, sizeof(buf), " waited %u (%s)", r.stall_cycles, stalls[r.stall]);
+		s += buf;
+	}
+	return s;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+		usage();
+	const char *log_name = argv[1];
+	FILE *out = stdout;
+	unsigned long long ticks = 1000;
+	for (int i = 2; i < argc; i++) {
+		if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+			out = fopen(argv[++i], "w");
+			if (out == NULL) {
+				fprintf(stderr, "sim_pipeview: cannot create %s\n", argv[i]);
+				return 1;
+			}
+		} else if ((strcmp(argv[i], "-ticks") == 0) && (i + 1 < argc))
+			ticks = strtoull(argv[++i], NULL, 0);
+		else
+			usage();
+	}
+
+	FILE *log = fopen(log_name, "rb");
+	if (log == NULL) {
+		fprintf(stderr, "sim_pipeview: cannot open %s\n", log_name);
+		return 1;
+	}
+	SimPipeviewHeader h;
+	if ((fread(&h, sizeof(h), 1, log) != 1) || (h.magic != SIM_PIPEVIEW_MAGIC)
+	|| (h.version != SIM_PIPEVIEW_VERSION) || (h.rec_size != sizeof(SimPipeviewRec))) {
+		fprintf(stderr, "sim_pipeview: %s is not a pipeline log of this version\n", log_name);
+		return 1;
+	}
+	// Records are in writeback order: sort them into program order
+	std::vector<SimPipeviewRec> recs;
+	SimPipeviewRec r;
+	while (fread(&r, sizeof(r), 1, log) == 1)
+		recs.push_back(r);
+	fclose(log);
+	std::sort(recs.begin(), recs.end(), by_seq);
+
+	for (size_t i = 0; i < recs.size(); i++) {
+		const SimPipeviewRec &u = recs[i];
+		unsigned long long arrived = (u.dispatch - u.stall_cycles) * ticks;
+		fprintf(out, "O3PipeView:fetch:%llu:0x%08x:0:%llu:%s\n", arrived, 0, (unsigned long long) u.seq, describe(u).c_str());
+		fprintf(out, "O3PipeView:decode:%llu\n", arrived);
+		fprintf(out, "O3PipeView:rename:%llu\n", (unsigned long long) u.dispatch * ticks);
+		fprintf(out, "O3PipeView:dispatch:%llu\n", (unsigned long long) u.dispatch * ticks);
+		fprintf(out, "O3PipeView:issue:%llu\n", (unsigned long long) u.issue * ticks);
+		fprintf(out, "O3PipeView:complete:%llu\n", (unsigned long long) u.complete * ticks);
+		fprintf(out, "O3PipeView:retire:%llu:store:%llu\n", (unsigned long long) u.writeback * ticks,
+		        (u.opcode == SIM_OP_STORE)? (unsigned long long) u.writeback * ticks : 0ULL);
+	}
+	if (out != stdout)
+		fclose(out);
+	fprintf(stderr, "sim_pipeview: %zu uops (1 in %u, dispatched from cycle %llu", recs.size(), h.sample, (unsigned long long) h.start);
+	if (h.end > 0)
+		fprintf(stderr, " to %llu", (unsigned long long) h.end);
+	fprintf(stderr, ")\n");
+	return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef SIM_PIPEVIEW_H
+#define SIM_PIPEVIEW_H
+
+#include <stdint.h>
+
+// ------------------------- Pipeline event log ------------------------
+// With -pipeview <file> the simulator writes one record per uop to file when its result is
+//   written on the CDB: a header, then SimPipeviewRec records in writeback order (not program
+//   order). sim_pipeview converts the log to gem5's O3PipeView text, which Konata and gem5's
+//   util/o3-pipeview.py display.
+// -pipeview_sample N keeps one uop in N (by sequence number) and -pipeview_start/_end keep
+//   the uops dispatched in that cycle window.
+#define SIM_PIPEVIEW_MAGIC   0x5745495645504950ULL   // "PIPEVIEW"
+#define SIM_PIPEVIEW_VERSION 2
+
+// Why a uop waited to dispatch
+enum SIM_PV_STALL {
+  SIM_PV_STALL_NONE = 0,
+  SIM_PV_STALL_RS_FULL,     // No free reservation station
+  SIM_PV_STALL_NO_PREG,     // No free physical register
+  SIM_PV_STALL_FRONTEND,    // Fetch or decode bandwidth ran out
+};
+
+struct SimPipeviewHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t rec_size;       // sizeof(SimPipeviewRec)
+  uint32_t sample;         // -pipeview_sample
+  uint32_t reserved;
+  uint64_t start, end;     // -pipeview_start, -pipeview_end (0: no end)
+};
+
+struct SimPipeviewRec {
+  uint64_t seq;            // Dispatch order
+  uint64_t dispatch;       // Cycle it was placed in a reservation station
+  uint64_t issue;          // Cycle its execution started
+  uint64_t complete;       // Cycle its result was due at the end of the FU pipeline
+  uint64_t writeback;      // Cycle its result was written on a CDB
+  uint32_t src1, src2, src3, dst;  // Registers (0: none)
+  uint32_t stall_cycles;   // Cycles it waited to dispatch
+  uint8_t  opcode;         // sim_opcode
+  uint8_t  stall;          // SIM_PV_STALL: why it waited (the last reason)
+  uint16_t fu_num;         // The unit of its FU type which executed it
+  uint16_t tid;            // SMT thread context
+  uint16_t cluster;
+  uint32_t replays;        // Speculative issues replayed before it executed
+};
+
+#endif
@@ -0,0 +1,110 @@
+// -------------------------------------------------------------------
+// Result cache maintenance (see -rcache in sim_pin.cpp)
+//
+// sim_rcache list  <dir>                     list the stored results, newest first
+// sim_rcache prune <dir> [-days D] [-keep N] delete results older than D days and/or
+//                                            all but the newest N results
+// -------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+struct Entry {
+	std::string file;
+	std::string key;
+	std::string workload;
+	time_t      mtime;
+	off_t       size;
+	bool operator<(const Entry &e) const { return mtime > e.mtime; }  // newest first
+};
+
+bool read_entries(const std::string &dir, std::vector<Entry> &entries)
+{
+	DIR *d = opendir(dir.c_str());
+	if (d == NULL) {
+		fprintf(stderr, "sim_rcache: cannot open %s\n", dir.c_str());
+		return false;
+	}
+	struct dirent *de;
+	while ((de = readdir(d)) != NULL) {
+		std::string name = de->d_name;
+		if ((name.size() <= 6) || (name.compare(name.size() - 6, 6, ".stats") != 0))
+			continue;
+		Entry e;
+		struct stat st;
+		e.file = dir + "/" + name;
+		if (stat(e.file.c_str(), &st) != 0)
+			continue;
+		e.key   = name.substr(0, name.size() - 6);
+		e.mtime = st.st_mtime;
+		e.size  = st.st_size;
+		std::ifstream in(e.file.c_str());
+		std::string line;
+		while (std::getline(in, line) && !line.empty())
+			if (line.compare(0, 12, "# workload: ") == 0)
+				e.workload = line.substr(12);
+		entries.push_back(e);
+	}
+	closedir(d);
+	std::sort(entries.begin(), entries.end());
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		fprintf(stderr, "usage: sim_rcache list <dir> | prune <dir> [-days D] [-keep N]\n");
+		return 1;
+	}
+	std::string cmd = argv[1], dir = argv[2];
+	std::vector<Entry> entries;
+	if (!read_entries(dir, entries))
+		return 1;
+
+	if (cmd == "list") {
+		char when[32];
+		for (size_t i = 0; i < entries.size(); i++) {
+			strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&entries[i].mtime));
+			printf("%s  %s  %8lld  %s\n", entries[i].key.c_str(), when, (long long) entries[i].size,
+			       entries[i].workload.c_str());
+		}
+		printf("%u results\n", (unsigned) entries.size());
+		return 0;
+	}
+
+	if (cmd == "prune") {
+		double days = -1;
+		long keep = -1;
+		for (int a = 3; a + 1 < argc; a += 2) {
+			if (strcmp(argv[a], "-days") == 0)
+				days = atof(argv[a + 1]);
+			else if (strcmp(argv[a], "-keep") == 0)
+				keep = atol(argv[a + 1]);
+			else {
+				fprintf(stderr, "sim_rcache: unknown option %s\n", argv[a]);
+				return 1;
+			}
+		}
+		time_t now = time(NULL);
+		unsigned removed = 0;
+		for (size_t i = 0; i < entries.size(); i++) {
+			bool too_old  = (days >= 0) && (difftime(now, entries[i].mtime) > days * 86400);
+			bool too_many = (keep >= 0) && ((long) i >= keep);
+			if ((too_old || too_many) && (unlink(entries[i].file.c_str()) == 0))
+				removed++;
+		}
+		printf("removed %u of %u results\n", removed, (unsigned) entries.size());
+		return 0;
+	}
+
+	fprintf(stderr, "sim_rcache: unknown command %s\n", cmd.c_str());
+	return 1;
+}
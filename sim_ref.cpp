@@ -0,0 +1,288 @@
+// -------------------------------------------------------------------
+// Reference timing core (see sim_ref.h)
+//
+// The dispatch, execute and write-result stages of the original sim_uop.cpp, with
+//   the knobs read from a sim_config, the debugging messages left out and the event
+//   hook of sim_check added. Keep it that way: it is only useful as long as it does
+//   not share code or data structures with the library core.
+// -------------------------------------------------------------------
+#include <string.h>
+#include <queue>
+#include <list>
+#include <vector>
+#include <algorithm>
+
+#include "sim_types.h"
+#include "sim.h"
+#include "sim_ref.h"
+
+namespace {
+
+// -------------------- Reservation Station -----------------------------------
+class ReservationStation {
+	public:
+		CPU_OPCODE_enum opCode;     // The operation of this instruction (IALU, etc)
+		UINT32          dstReg;     // The destination register
+		ReservationStation *src1;   // Pointer to a source RS which will produce a result. Null, if this source is ready
+		ReservationStation *src2;   // ditto
+		ReservationStation *src3;   // ditto
+		bool to_be_executed;
+		UINT64 seq;                 // Dispatch order, for the event hook
+
+		ReservationStation(CPU_OPCODE_enum _opCode, UINT32 _dstReg, UINT64 _seq)
+		{
+			opCode = _opCode;
+			dstReg = _dstReg;
+			src1 = src2 = src3 = NULL;
+			to_be_executed = false;
+			seq = _seq;
+		}
+};
+
+// --------------------- FUs and RS pool combo -----------------------------------
+// One per FU type. The RS pool is in program order.
+class ResStationFuncUnit {
+	public:
+		UINT32  pipe_depth;          // Number of pipeline stages
+		UINT32  initiation_interval; // Number of cycles between subsequent executions (for each unit)
+		UINT32  latency;             // Latency of execution (cycles required for the result to be produced)
+
+		UINT32  num_fus;
+		std::vector<UINT64> last_init;       // Last execution initiation time, per unit
+		std::vector<UINT32> ops_in_progress; // Number of operations in progress, per unit
+
+		UINT32  num_rs;
+		std::list<ReservationStation *> rs_pool;
+
+		ResStationFuncUnit(UINT32 _num_fus, UINT32 _num_rs, UINT32 _pipe_depth, UINT32 _initiation_interval, UINT32 _latency)
+		{
+			num_fus = _num_fus;
+			num_rs  = _num_rs;
+			pipe_depth          = _pipe_depth;
+			initiation_interval = _initiation_interval;
+			latency             = _latency;
+			ops_in_progress.resize(num_fus, 0);
+			last_init.resize(num_fus, 0);
+		}
+};
+
+ResStationFuncUnit *rs_fu[LAST_FU];
+
+// The RS which will produce each register, NULL if the register has a valid value
+std::vector<ReservationStation *> registerStatus;
+
+// --------------------------- Event Queue ------------------------------------
+class EventQ_Item {
+	public:
+		UINT64              dueCycle;  // The cycle when the result is produced
+		ResStationFuncUnit *rsfu;
+		ReservationStation *rs;        // The RS entry producing the result
+		UINT32              fu_num;
+
+		EventQ_Item(UINT64 _dueCycle, ResStationFuncUnit *_rs_fu, ReservationStation *_rs, UINT32 funum)
+		{
+			dueCycle = _dueCycle;
+			rsfu     = _rs_fu;
+			rs       = _rs;
+			fu_num   = funum;
+		}
+};
+
+class EventQ_cmp {
+	public:
+		bool operator()(EventQ_Item *lhs, EventQ_Item *rhs)
+		{
+			return (lhs->dueCycle > rhs->dueCycle);
+		}
+};
+
+std::priority_queue<EventQ_Item *, std::vector<EventQ_Item *>, EventQ_cmp> g_eventQ;
+
+UINT64 g_cycle;           // Cycle counter
+UINT32 g_dispatch_count;  // Instructions dispatched in this cycle
+UINT32 g_disp_width, g_cdb_width;
+UINT64 g_seq;             // Sequence number of the next dispatched instruction
+
+sim_event_fn g_hook;
+void        *g_hook_ctx;
+
+void run_Execute_stage()
+{
+	for (int i = MEMOP; i < LAST_FU; i++) {  // For all types of FUs
+		for (UINT32 ii = 0; ii < rs_fu[i]->num_fus; ii++) {  // For each FU of type i
+			if ((g_cycle - rs_fu[i]->last_init[ii]) < rs_fu[i]->initiation_interval)
+				continue;
+			if (rs_fu[i]->ops_in_progress[ii] == rs_fu[i]->pipe_depth)
+				continue;
+			// The oldest ready instruction which has not started yet
+			for (std::list<ReservationStation *>::iterator it = rs_fu[i]->rs_pool.begin(); it != rs_fu[i]->rs_pool.end(); it++) {
+				ReservationStation *rs_p = *it;
+				if ((rs_p->src1 == NULL) && (rs_p->src2 == NULL) && (rs_p->src3 == NULL) && !rs_p->to_be_executed) {
+					rs_fu[i]->ops_in_progress[ii]++;
+					rs_fu[i]->last_init[ii] = g_cycle;
+					g_eventQ.push(new EventQ_Item(g_cycle + rs_fu[i]->latency, rs_fu[i], rs_p, ii));
+					rs_p->to_be_executed = true;
+					g_hook(g_cycle, 'E', rs_p->seq, g_hook_ctx);
+					break;
+				}
+			}
+		}
+	}
+}
+
+void run_WriteResult_stage()
+{
+	for (UINT32 cdb_count = 0; cdb_count < g_cdb_width; cdb_count++) {   // For each common data bus
+		if (g_eventQ.empty())
+			break;
+		EventQ_Item *ev_item = g_eventQ.top();
+		if (g_cycle < ev_item->dueCycle)
+			break;
+		ReservationStation *dres = ev_item->rs;
+		g_hook(g_cycle, 'W', dres->seq, g_hook_ctx);
+
+		std::list<ReservationStation *>::iterator itPool = std::find(ev_item->rsfu->rs_pool.begin(), ev_item->rsfu->rs_pool.end(), dres);
+		ev_item->rsfu->ops_in_progress[ev_item->fu_num]--;
+
+		// Wake up the dependents in every pool, and the registers
+		for (int i = MEMOP; i < LAST_FU; i++) {
+			for (std::list<ReservationStation *>::iterator it = rs_fu[i]->rs_pool.begin(); it != rs_fu[i]->rs_pool.end(); it++) {
+				ReservationStation *rs_p = *it;
+				if (rs_p->src1 == dres) rs_p->src1 = NULL;
+				if (rs_p->src2 == dres) rs_p->src2 = NULL;
+				if (rs_p->src3 == dres) rs_p->src3 = NULL;
+			}
+		}
+		for (UINT32 r = 0; r < registerStatus.size(); r++)
+			if (registerStatus[r] == dres)
+				registerStatus[r] = NULL;
+
+		ev_item->rsfu->rs_pool.erase(itPool);
+		g_eventQ.pop();
+		delete ev_item;
+		delete dres;
+	}
+}
+
+// Write-result before execute, so that a result wakes up its dependents for this cycle
+void new_cycle()
+{
+	g_cycle++;
+	run_WriteResult_stage();
+	run_Execute_stage();
+}
+
+} // namespace
+
+// The switches of the parameters the reference does not model
+#define REF_UNMODELLED(X) \
+	X(cdb_policy, "cdb_policy") X(cdb_fu_order, "cdb_fu_order") X(fu_out_buf, "fu_out_buf") \
+	X(smt, "smt") X(smt_fetch, "smt_fetch") X(smt_rs_part, "smt_rs_part") X(smt_queue, "smt_queue") \
+	X(fetch_bytes, "fetch_bytes") X(decode_width, "decode_width") X(uc_sets, "uop_cache_sets") \
+	X(uc_ways, "uop_cache_ways") X(fusion, "fusion") X(phys_int, "phys_int") X(phys_fp, "phys_fp") \
+	X(clusters, "clusters") X(cluster_steer, "cluster_steer") X(cluster_bypass, "cluster_bypass") \
+	X(sched_depth, "sched_depth") X(spec_wakeup, "spec_wakeup") X(load_miss_pct, "load_miss_pct") \
+	X(load_miss_lat, "load_miss_lat") X(df_window, "dataflow_window")
+
+std::string ref_base_config(const sim_config *cfg, sim_config *base)
+{
+	sim_config def;
+	sim_config_default(&def);
+	*base = *cfg;
+	std::string reset;
+#define REF_RESET(field, name) \
+	if (memcmp(&base->field, &def.field, sizeof(def.field)) != 0) { \
+		memcpy(&base->field, &def.field, sizeof(def.field)); \
+		reset += std::string(reset.empty()? "" : ", ") + name; \
+	}
+	REF_UNMODELLED(REF_RESET)
+#undef REF_RESET
+	return reset;
+}
+
+void ref_create(const sim_config *cfg, sim_event_fn hook, void *ctx)
+{
+	// As the original: the FP and integer multiply/divide units take the IALU pipeline
+	//   depth, and a memory operation the address-generation latency.
+	rs_fu[MEMOP] = new ResStationFuncUnit(cfg->num_mem,   cfg->num_rs_mem,  cfg->mem_pdepth,  cfg->mem_ivl,  cfg->mem_add_lat);
+	rs_fu[IALU]  = new ResStationFuncUnit(cfg->num_ialus, cfg->num_rs_ialu, cfg->ialu_pdepth, cfg->ialu_ivl, cfg->ialu_lat);
+	rs_fu[IMUL]  = new ResStationFuncUnit(cfg->num_imuls, cfg->num_rs_imul, cfg->ialu_pdepth, cfg->imul_ivl, cfg->imul_lat);
+	rs_fu[IDIV]  = new ResStationFuncUnit(cfg->num_idivs, cfg->num_rs_idiv, cfg->ialu_pdepth, cfg->idiv_ivl, cfg->idiv_lat);
+	rs_fu[FALU]  = new ResStationFuncUnit(cfg->num_falus, cfg->num_rs_falu, cfg->ialu_pdepth, cfg->falu_ivl, cfg->falu_lat);
+	rs_fu[FMUL]  = new ResStationFuncUnit(cfg->num_fmuls, cfg->num_rs_fmul, cfg->ialu_pdepth, cfg->fmul_ivl, cfg->fmul_lat);
+	rs_fu[FDIV]  = new ResStationFuncUnit(cfg->num_fdivs, cfg->num_rs_fdiv, cfg->ialu_pdepth, cfg->fdiv_ivl, cfg->fdiv_lat);
+	registerStatus.assign(cfg->num_regs, NULL);
+	g_cycle = 0;
+	g_dispatch_count = 0;
+	g_disp_width = cfg->disp_width;
+	g_cdb_width  = cfg->cdb_width;
+	g_seq = 0;
+	g_hook = hook;
+	g_hook_ctx = ctx;
+}
+
+void ref_destroy()
+{
+	while (!g_eventQ.empty()) {
+		delete g_eventQ.top();
+		g_eventQ.pop();
+	}
+	for (int i = MEMOP; i < LAST_FU; i++) {
+		for (std::list<ReservationStation *>::iterator it = rs_fu[i]->rs_pool.begin(); it != rs_fu[i]->rs_pool.end(); it++)
+			delete *it;
+		delete rs_fu[i];
+		rs_fu[i] = NULL;
+	}
+	registerStatus.clear();
+}
+
+void ref_uop(const sim_uop_rec *uop)
+{
+	CPU_OPCODE_enum opCode = (CPU_OPCODE_enum) uop->opcode;
+	UINT32 fu_type = ((opCode == LOAD) || (opCode == STORE))? MEMOP : opCode;
+	bool instruction_can_dispatch;
+	do {
+		instruction_can_dispatch = (rs_fu[fu_type]->rs_pool.size() != rs_fu[fu_type]->num_rs);
+		bool is_new_cycle = false;
+		if (instruction_can_dispatch) {
+			ReservationStation *res = new ReservationStation(opCode, uop->dst, g_seq++);
+			g_hook(g_cycle, 'D', res->seq, g_hook_ctx);
+			if ((uop->src1 != 0) && (registerStatus[uop->src1] != NULL))
+				res->src1 = registerStatus[uop->src1];
+			if ((uop->src2 != 0) && (registerStatus[uop->src2] != NULL))
+				res->src2 = registerStatus[uop->src2];
+			if ((opCode == STORE) && (uop->src3 != 0) && (registerStatus[uop->src3] != NULL))   // Only a store reads src3
+				res->src3 = registerStatus[uop->src3];
+			registerStatus[uop->dst] = res;   // Even a store's, as the original
+			rs_fu[fu_type]->rs_pool.push_back(res);
+
+			g_dispatch_count++;
+			if (g_dispatch_count == g_disp_width) {
+				is_new_cycle = true;
+				g_dispatch_count = 0;
+			}
+		} else {   // Dispatch is stalled. Move on to the next cycle
+			is_new_cycle = true;
+			g_dispatch_count = 0;
+		}
+		if (is_new_cycle)
+			new_cycle();
+	} while (!instruction_can_dispatch);
+}
+
+void ref_drain()
+{
+	for (;;) {
+		bool busy = !g_eventQ.empty();
+		for (int i = MEMOP; i < LAST_FU; i++)
+			busy = busy || !rs_fu[i]->rs_pool.empty();
+		if (!busy)
+			break;
+		new_cycle();
+	}
+}
+
+uint64_t ref_cycle()
+{
+	return g_cycle;
+}
@@ -0,0 +1,32 @@
+#ifndef SIM_REF_H
+#define SIM_REF_H
+
+// -------------------------------------------------------------------
+// Reference timing core for sim_check -diff: the list-based Tomasulo core of the
+//   original sim_uop.cpp (with the event queue holding RS pointers), kept apart from
+//   libsimcore as an independent model of the base machine. It has none of the later
+//   features (SMT, front-end, physical registers, clusters, CDB policies, speculative
+//   scheduling) and none of the data-structure changes, so a timing change of the
+//   library on the base machine shows up as a divergence from it.
+// -------------------------------------------------------------------
+#include <stdint.h>
+#include <string>
+
+#include "sim_api.h"
+
+// The machine of cfg as the reference models it: base is cfg with the parameters the
+//   reference does not model reset to their defaults. Returns the switches of those
+//   which were set, ", "-separated (empty if the reference models all of cfg).
+std::string ref_base_config(const sim_config *cfg, sim_config *base);
+
+// One reference core at a time, like the library. Events go to the hook, with the
+//   stages and sequence numbers of sim_event_fn.
+void     ref_create(const sim_config *cfg, sim_event_fn hook, void *ctx);
+void     ref_destroy();
+// Dispatch one uop, simulating cycles until it can
+void     ref_uop(const sim_uop_rec *uop);
+// Advance the clock until every uop has written its result
+void     ref_drain();
+uint64_t ref_cycle();
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef SIM_TELEMETRY_H
+#define SIM_TELEMETRY_H
+
+#include <stdint.h>
+
+// ------------------------- Live telemetry ----------------------------
+// With -telemetry <name> the simulator publishes this struct in the shared-memory
+//   segment <name> (/dev/shm/<name>) every -telemetry_interval cycles; sim_top reads it.
+// Only plain fixed-size types: the reader is a separate program.
+//
+// The fields are protected by a seqlock: the simulator makes seq odd, writes the fields,
+//   then makes seq even again. A reader copies the struct and retries if seq was odd or
+//   changed meanwhile. The simulator never waits for readers.
+#define SIM_TELEMETRY_MAGIC   0x4d4c4554534f4d54ULL   // "TMOSTELM"
+#define SIM_TELEMETRY_VERSION 1
+
+struct SimTelemetry {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t pid;                // Simulator process
+  uint64_t seq;                // Seqlock sequence, odd while the fields are being written
+
+  uint64_t cycle;              // Simulated cycles (including warm-up)
+  uint64_t measured_cycles;    // Cycles since warm-up ended
+  uint64_t uops_dispatched;    // After warm-up
+  uint64_t uops_wb;            // After warm-up
+  double   ipc;                // uops_wb / measured_cycles
+  uint64_t stall_rs_full;      // Dispatch stall cycles by reason, after warm-up
+  uint64_t stall_no_preg;
+  uint64_t stall_frontend;
+  double   host_seconds;       // Since sim_init()
+  double   host_uops_per_sec;  // Uops simulated per host second, over the last interval
+  uint32_t warming_up;         // Warm-up cycles remain
+  uint32_t finished;           // The simulation has ended; no more updates
+};
+
+// Seqlock read: copy the published struct into *out. Returns false if the writer
+//   kept it busy for every attempt.
+inline bool sim_telemetry_read(const SimTelemetry *shm, SimTelemetry *out)
+{
+  for (int attempt = 0; attempt < 1000; attempt++) {
+    uint64_t seq1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+    if (seq1 & 1)
+      continue;
+    __builtin_memcpy(out, (const void *) shm, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq1)
+      return true;
+  }
+  return false;
+}
+
+#endif
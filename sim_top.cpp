@@ -0,0 +1,120 @@
+// -------------------------------------------------------------------
+// Live statistics of a running simulation (see -telemetry in sim_uop.cpp)
+//
+// sim_top <name> [-i S] [-n N] [-csv file]  print the statistics every S seconds (default 1)
+//                                           until the simulation ends or N samples were
+//                                           printed; -csv also records them to file
+// sim_top -unlink <name>                    remove the segment of a finished simulation
+// -------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <string>
+#include "sim_telemetry.h"
+
+void usage()
+{
+	fprintf(stderr, "usage: sim_top <name> [-i seconds] [-n samples] [-csv file]\n"
+	                "       sim_top -unlink <name>\n");
+	exit(1);
+}
+
+// The segment name as given to -telemetry, with the leading '/' shm_open() expects
+std::string shm_name(const char *name)
+{
+	return (name[0] == '/')? std::string(name) : "/" + std::string(name);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+		usage();
+	if (strcmp(argv[1], "-unlink") == 0) {
+		if ((argc != 3) || (shm_unlink(shm_name(argv[2]).c_str()) != 0)) {
+			fprintf(stderr, "sim_top: cannot remove %s\n", (argc == 3)? argv[2] : "");
+			return 1;
+		}
+		return 0;
+	}
+
+	const char *name = argv[1];
+	double interval = 1.0;
+	long samples = 0;   // 0: until the simulation ends
+	FILE *csv = NULL;
+	for (int i = 2; i < argc; i++) {
+		if ((strcmp(argv[i], "-i") == 0) && (i + 1 < argc))
+			interval = atof(argv[++i]);
+		else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+			samples = atol(argv[++i]);
+		else if ((strcmp(argv[i], "-csv") == 0) && (i + 1 < argc)) {
+			csv = fopen(argv[++i], "w");
+			if (csv == NULL) {
+				fprintf(stderr, "sim_top: cannot create %s\n", argv[i]);
+				return 1;
+			}
+		} else
+			usage();
+	}
+
+	int fd = shm_open(shm_name(name).c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "sim_top: no telemetry segment %s\n", name);
+		return 1;
+	}
+	const SimTelemetry *shm = (const SimTelemetry *) mmap(NULL, sizeof(SimTelemetry), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		fprintf(stderr, "sim_top: cannot map %s\n", name);
+		return 1;
+	}
+	if ((shm->magic != SIM_TELEMETRY_MAGIC) || (shm->version != SIM_TELEMETRY_VERSION)) {
+		fprintf(stderr, "sim_top: %s is not a telemetry segment of this version\n", name);
+		return 1;
+	}
+
+	const char *header = "cycle,measured_cycles,uops_dispatched,uops_wb,ipc,interval_ipc,"
+	                     "stall_rs_full,stall_no_preg,stall_frontend,host_seconds,host_uops_per_sec";
+	printf("pid %u\n", shm->pid);
+	printf("%14s %14s %8s %8s %12s %12s %12s %12s\n", "cycle", "uops wb", "IPC", "int IPC",
+	       "stall RS", "stall preg", "stall FE", "uops/s");
+	if (csv != NULL)
+		fprintf(csv, "%s\n", header);
+
+	SimTelemetry cur, prev;
+	memset(&prev, 0, sizeof(prev));
+	for (long n = 0; (samples == 0) || (n < samples); n++) {
+		if (!sim_telemetry_read(shm, &cur)) {
+			fprintf(stderr, "sim_top: segment busy\n");
+			return 1;
+		}
+		// IPC since the previous sample; measured_cycles restarts when warm-up ends
+		double interval_ipc = cur.ipc;
+		if ((n > 0) && !prev.warming_up && (cur.measured_cycles > prev.measured_cycles))
+			interval_ipc = (double) (cur.uops_wb - prev.uops_wb) / (cur.measured_cycles - prev.measured_cycles);
+		printf("%14llu %14llu %8.3f %8.3f %12llu %12llu %12llu %12.0f%s\n",
+		       (unsigned long long) cur.cycle, (unsigned long long) cur.uops_wb, cur.ipc, interval_ipc,
+		       (unsigned long long) cur.stall_rs_full, (unsigned long long) cur.stall_no_preg,
+		       (unsigned long long) cur.stall_frontend, cur.host_uops_per_sec,
+		       cur.warming_up? " (warm-up)" : "");
+		fflush(stdout);
+		if (csv != NULL) {
+			fprintf(csv, "%llu,%llu,%llu,%llu,%f,%f,%llu,%llu,%llu,%f,%f\n",
+			        (unsigned long long) cur.cycle, (unsigned long long) cur.measured_cycles,
+			        (unsigned long long) cur.uops_dispatched, (unsigned long long) cur.uops_wb,
+			        cur.ipc, interval_ipc, (unsigned long long) cur.stall_rs_full,
+			        (unsigned long long) cur.stall_no_preg, (unsigned long long) cur.stall_frontend,
+			        cur.host_seconds, cur.host_uops_per_sec);
+			fflush(csv);
+		}
+		if (cur.finished)
+			break;
+		prev = cur;
+		usleep((useconds_t) (interval * 1e6));
+	}
+	if (csv != NULL)
+		fclose(csv);
+	return 0;
+}
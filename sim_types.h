@@ -0,0 +1,22 @@
+#ifndef SIM_TYPES_H
+#define SIM_TYPES_H
+
+// -------------------------------------------------------------------
+// The Pin-style integer types the timing core (sim_uop.cpp) is written in,
+//   so that the core builds without pin.H (see sim_api.h).
+// -------------------------------------------------------------------
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <list>
+
+using namespace std;
+
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef int32_t  INT32;
+
+#endif
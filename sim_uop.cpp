@@ -1,5 +1,6 @@
-#include "pin.H"
+#include "sim_types.h"   // The core is built without Pin (see sim_api.h)
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -7,9 +8,33 @@
 #include <queue>
 #include <list>
 #include <vector>
+#include <algorithm>
 #include <new> 
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "sim.h"
+#include "sim_api.h"
+#include "sim_telemetry.h"
+#include "sim_pipeview.h"
 
+// The handle of the C API (sim_api.h). The core's state is global, so there is only one.
+struct sim_core {
+	bool created;
+};
+
+// Everything but the C API at the end of the file is private to the core, so that
+//   programs linked with it (sim_bench, sim_check, ...) are free to use the same names.
+namespace {
+
+string opcode2String(CPU_OPCODE_enum opcode)
+{
+	return sim_opcode_name(opcode);
+}
+
+
+const UINT32 PREG_NONE = 0xffffffff;
 
 // -------------------- Reservation Station -----------------------------------
 class ReservationStation {
@@ -20,6 +45,24 @@ class ReservationStation {
 		ReservationStation *src2;   // ditto
 		ReservationStation *src3;   // ditto
 		bool to_be_executed;
+		UINT32          tid;        // Hardware thread context that dispatched this instruction (0 without SMT)
+		UINT64          seq;        // Dispatch sequence number (program order, across all threads)
+		UINT32          dstSlot;    // Rename map entry of dstReg (0 if there is no destination)
+		UINT32          preg;       // Physical register allocated for the result (PREG_NONE if none)
+		UINT32          cluster;    // Back-end cluster it was steered to (0 without clustering)
+		UINT64          ready_cycle;// Earliest execution cycle, delayed by operands bypassed from other clusters
+		// For the pipeline log (-pipeview)
+		UINT32          srcReg1, srcReg2, srcReg3;
+		UINT64          dispatch_cycle;
+		UINT64          issue_cycle;
+		UINT32          fu_num;     // Unit which executes it
+		UINT32          stall;      // Why it waited to dispatch (DISPATCH_STALL)
+		UINT32          stall_cycles;
+		// Speculative scheduling (-spec_wakeup)
+		UINT64          wakeup_cycle;  // Cycle its dependents may execute: its issue plus its predicted latency
+		UINT64          cancel_cycle;  // Cycle the replay of its last speculative issue was signalled
+		UINT32          replays;       // Speculative issues replayed
+		bool            load_miss;     // A LOAD which misses in the data cache
 		// ------------------------------------------------------------------------
 		// Add any other variables you need here
 		void set_dst(UINT32 dst1){
@@ -40,7 +83,8 @@ class ReservationStation {
 				UINT32          _dstReg,
 				ReservationStation *_src1,
 				ReservationStation *_src2,
-				ReservationStation *_src3)
+				ReservationStation *_src3,
+				UINT32          _tid)
 		{
 			opCode = _opCode;
 			dstReg = _dstReg;
@@ -48,6 +92,22 @@ class ReservationStation {
 			src2 = _src2;
 			src3 = _src3;
 			to_be_executed=false;
+			tid = _tid;
+			seq = 0;
+			dstSlot = 0;
+			preg = PREG_NONE;
+			cluster = 0;
+			ready_cycle = 0;
+			srcReg1 = srcReg2 = srcReg3 = 0;
+			dispatch_cycle = 0;
+			issue_cycle = 0;
+			fu_num = 0;
+			stall = 0;
+			stall_cycles = 0;
+			wakeup_cycle = 0;
+			cancel_cycle = 0;
+			replays = 0;
+			load_miss = false;
 			// ----------------------------------------------------------------------
 			// Add code to initialize other object variables here
 		}
@@ -78,9 +138,17 @@ class ResStationFuncUnit{
 		UINT32  num_fus; // Number of FUs of this type 
 		std::vector<UINT64> last_init;       // Last execution initiation time, per unit
 		std::vector<UINT32> ops_in_progress; // Number of operations in progress, per unit
+		std::vector<UINT32> out_buf;         // Results waiting for a CDB in the output buffer, per unit
 
 		UINT32  num_rs;  // Number of reservation stations shared by all FUs of this type
 		std::list<ReservationStation *> rs_pool;  // The reservation station pool, common to all FUs of this object
+		std::vector<UINT32> rs_per_thread;        // Occupied RS per SMT thread context (for static partitioning)
+
+		// Clustering: unit ii belongs to cluster (ii % clusters), so only the first
+		//   min(num_fus, clusters) clusters have units of this type and RS for them.
+		UINT32  num_clusters;                      // Clusters with units of this type
+		std::vector<UINT32> rs_cluster_share;      // RS per cluster: num_rs split evenly, the first clusters get the remainder
+		std::vector<UINT32> rs_per_cluster;        // Occupied RS per cluster
 
 		// Constructor
 		ResStationFuncUnit(CPU_OPCODE_enum _fu_type,
@@ -99,6 +167,7 @@ class ResStationFuncUnit{
 			// Set the number of entries of these 2 vectors. All entries contain 0
 			ops_in_progress.resize(num_fus, 0);
 			last_init.resize(num_fus, 0);
+			out_buf.resize(num_fus, 0);
 		}
 };
 
@@ -111,7 +180,25 @@ ResStationFuncUnit *rs_fu[LAST_FU];
 // These are ReservationStation pointers so they can hold the current "tag" of a register,
 //   i.e. point to the RS which will be producing the result they expect.
 // This is NULL if the register has a valid value.
-std::vector<ReservationStation *> registerStatus(REG_LAST, NULL);
+// There is one rename table per hardware thread context: SMT threads share the RS pools,
+//   FUs and CDBs but never each other's registers.
+// The tables are compact: they are indexed by the slot of a register (g_reg_slot), assigned
+//   the first time the register is written, so they only hold the registers in use.
+std::vector< std::vector<ReservationStation *> > registerStatus;
+std::vector<UINT32> g_reg_slot;   // Register -> rename table slot; 0: never written (slot 0 is unused)
+
+// -------------------------- Physical registers ------------------------------
+// Every result in flight holds a physical register of its class from dispatch until
+//   it is written on the CDB. With phys_int/phys_fp set to 0 the class is unlimited.
+//   The class is that of the destination register (sim_set_reg_class()), or, for a
+//   register without one, that of the opcode.
+enum REG_CLASS { RC_INT, RC_FP, RC_LAST };
+UINT32              g_num_pregs[RC_LAST];   // Physical registers per class (0: unlimited)
+std::vector<UINT32> g_free_pregs[RC_LAST];  // Free list per class, used as a stack
+std::vector<UINT32> g_reg_class;            // Register -> REG_CLASS; RC_LAST: by the opcode
+
+// Why an instruction could not dispatch (the values of SIM_PV_STALL in the pipeline log)
+enum DISPATCH_STALL { STALL_NONE = 0, STALL_RS_FULL, STALL_NO_PREG, STALL_FRONTEND };
 
 
 
@@ -123,12 +210,13 @@ class EventQ_Item
 		// -------------------------------------------------------------------
 		// Add any other variables you need here
 		ResStationFuncUnit *rsfu;
-		UINT32 res_station;
+		ReservationStation *rs;   // The RS entry producing the result
 		UINT32 fu_num;
+		bool   buffered;  // Waiting for a CDB in the FU's output buffer (see arbitrate_cdb())
 		// Constructor
 		EventQ_Item(UINT64 _dueCycle,
 			    ResStationFuncUnit *_rs_fu,
-			    UINT32 _res_station,
+			    ReservationStation *_rs,
 			    UINT32 funum
 				// ------------------------------------------------
 				// Add any other parameters you need here
@@ -137,8 +225,9 @@ class EventQ_Item
 		{
 			dueCycle    = _dueCycle;
 			rsfu = _rs_fu;
-			res_station = _res_station;
+			rs = _rs;
 			fu_num = funum;
+			buffered = false;
 			// --------------------------------------
 			// Add code to initialize other variables
 		}
@@ -160,128 +249,11 @@ std::priority_queue<EventQ_Item *, std::vector<EventQ_Item *>, EventQ_cmp> g_eve
 
 
 // ---------------------------------------------------------------------------
-// --------------------------------- KNOBS -----------------------------------
+// ------------------------------- PARAMETERS --------------------------------
 // ---------------------------------------------------------------------------
-// -------------------
-// Simulation control:
-// -------------------
-// Debug verbosity:
-// 0 - no messages
-// 1 - keep-alive messages (every 100 million cycles)
-// 2 - dispatch stage messages
-// 3 - execute stage messages
-// 4 - write-result stage messages
-KNOB<UINT32> Knob_verbose      (KNOB_MODE_WRITEONCE, "pintool", "verb",              "-1", "enable detailed messages for debugging");
-// Number of fast-forwarding instructions:
-KNOB<UINT64> Knob_num_ff       (KNOB_MODE_WRITEONCE, "pintool", "ffwd",              "0", "number of instructions for fast-forward simulation");
-// Number of warm-up cycles to simulate (before starting to take measurements):
-KNOB<UINT64> Knob_num_warmUp   (KNOB_MODE_WRITEONCE, "pintool", "warmUp",      "1000000", "number of cycles for warm-up");
-// Number of detailed cycles to simulate (including warm-up):
-KNOB<UINT64> Knob_num_detailed (KNOB_MODE_WRITEONCE, "pintool", "detailed", "1001000000", "number of cycles for detailed simulation, including warm-up");
-// NOTE: the last 2 knobs count cycles not instructions. For a wide processor the number of cycles are approximately
-//   (number of instructions) / (dispatch width)
-
-// ------------------------
-// Processor configuration
-// ------------------------
-// Number of instructions that can be dispatched in 1 cycle:
-KNOB<UINT32> Knob_disp_width (KNOB_MODE_WRITEONCE, "pintool", "dispatch_width", "1", "dispatch width of the processor");
-// Number of Common Data Busses (CDB), which carry results from functional units to all reservation stations and the register file:
-KNOB<UINT32> Knob_cdb_width  (KNOB_MODE_WRITEONCE, "pintool", "cdb_width",      "1", "number of Common Data Busses (CDB)");
-
-//------------------------------------
-// Number of functional units per type
-//  must have at least 1 per type.
-//------------------------------------
-
-// Number of memory ports/units:
-KNOB<UINT32> Knob_num_mem   (KNOB_MODE_WRITEONCE, "pintool", "num_mem",   "1", "number of memory ports");
-// Number of Integer ALUs:
-KNOB<UINT32> Knob_num_ialus (KNOB_MODE_WRITEONCE, "pintool", "num_ialus", "1", "number of integer ALUs");
-// Number of Integer multipliers:
-KNOB<UINT32> Knob_num_imuls (KNOB_MODE_WRITEONCE, "pintool", "num_imuls", "1", "number of integer multipliers");
-// Number of Integer divisors:
-KNOB<UINT32> Knob_num_idivs (KNOB_MODE_WRITEONCE, "pintool", "num_idivs", "1", "number of integer dividers");
-// Number of floating point (FP) ALUs:
-KNOB<UINT32> Knob_num_falus (KNOB_MODE_WRITEONCE, "pintool", "num_falus", "1", "number of FP ALUs");
-// Number of FP multipliers:
-KNOB<UINT32> Knob_num_fmuls (KNOB_MODE_WRITEONCE, "pintool", "num_fmuls", "1", "number of FP multipliers");
-// Number of FP divisors:
-KNOB<UINT32> Knob_num_fdivs (KNOB_MODE_WRITEONCE, "pintool", "num_fdivs", "1", "number of FP dividers");
-
-// -------------------------------------------------------
-// Number of reservation stations (RS) buffers per functional unit type
-// -------------------------------------------------------
-// Number of RS for memory ports/units:
-KNOB<UINT32> Knob_num_rs_mem  (KNOB_MODE_WRITEONCE, "pintool", "num_rs_mem",  "1", "number of reservation stations for memory");
-// Number of RS for IALU units:
-KNOB<UINT32> Knob_num_rs_ialu (KNOB_MODE_WRITEONCE, "pintool", "num_rs_ialu", "1", "number of reservation stations for integer ALUs");
-// Number of RS for IMUL units:
-KNOB<UINT32> Knob_num_rs_imul (KNOB_MODE_WRITEONCE, "pintool", "num_rs_imul", "1", "number of reservation stations for integer multipliers");
-// Number of RS for IDIV units:
-KNOB<UINT32> Knob_num_rs_idiv (KNOB_MODE_WRITEONCE, "pintool", "num_rs_idiv", "1", "number of reservation stations for integer dividers");
-// Number of RS for FP ALU units:
-KNOB<UINT32> Knob_num_rs_falu (KNOB_MODE_WRITEONCE, "pintool", "num_rs_falu", "1", "number of reservation stations for FP ALUs");
-// Number of RS for FP MUL units:
-KNOB<UINT32> Knob_num_rs_fmul (KNOB_MODE_WRITEONCE, "pintool", "num_rs_fmul", "1", "number of reservation stations for FP multipliers");
-// Number of RS for FP DIV units:
-KNOB<UINT32> Knob_num_rs_fdiv (KNOB_MODE_WRITEONCE, "pintool", "num_rs_fdiv", "1", "number of reservation stations for FP dividers");
-
-// ------------------------------
-// Functional unit pipeline depth
-// ------------------------------
-// Pipeline depth of memory ports/units:
-KNOB<UINT32> Knob_mem_pdepth  (KNOB_MODE_WRITEONCE, "pintool", "mem_pdepth",  "1", "memory port pipeline depth");
-// Pipeline depth of IALU units:
-KNOB<UINT32> Knob_ialu_pdepth (KNOB_MODE_WRITEONCE, "pintool", "ialu_pdepth", "1", "integer ALU pipeline depth");
-// Pipeline depth of IMUL units:
-KNOB<UINT32> Knob_imul_pdepth (KNOB_MODE_WRITEONCE, "pintool", "imul_pdepth", "1", "integer multiplier pipeline depth");
-// Pipeline depth of IDIV units:
-KNOB<UINT32> Knob_idiv_pdepth (KNOB_MODE_WRITEONCE, "pintool", "idiv_pdepth", "1", "integer divider pipeline depth");
-// Pipeline depth of FALU units:
-KNOB<UINT32> Knob_falu_pdepth (KNOB_MODE_WRITEONCE, "pintool", "falu_pdepth", "1", "FP ALU pipeline depth");
-// Pipeline depth of FMUL units:
-KNOB<UINT32> Knob_fmul_pdepth (KNOB_MODE_WRITEONCE, "pintool", "fmul_pdepth", "1", "FP multiplier pipeline depth");
-// Pipeline depth of FDIV units:
-KNOB<UINT32> Knob_fdiv_pdepth (KNOB_MODE_WRITEONCE, "pintool", "fdiv_pdepth", "1", "FP divider pipeline depth");
-
-// -------------------------
-// Functional unit latencies
-// -------------------------
-// Memory address-generation latency:
-KNOB<UINT32> Knob_mem_add_lat (KNOB_MODE_WRITEONCE, "pintool", "mem_add_lat", "1", "memory address-generation latency");
-// Memory access latency:
-KNOB<UINT32> Knob_mem_acc_lat (KNOB_MODE_WRITEONCE, "pintool", "mem_acc_lat", "1", "memory access latency");
-// IALU latency:
-KNOB<UINT32> Knob_ialu_lat    (KNOB_MODE_WRITEONCE, "pintool", "ialu_lat",    "1", "integer ALU latency");
-// IMUL latency:
-KNOB<UINT32> Knob_imul_lat    (KNOB_MODE_WRITEONCE, "pintool", "imul_lat",    "4", "integer multiplier latency");
-// IDIV latency:
-KNOB<UINT32> Knob_idiv_lat    (KNOB_MODE_WRITEONCE, "pintool", "idiv_lat",    "8", "integer divider latency");
-// FALU latency:
-KNOB<UINT32> Knob_falu_lat    (KNOB_MODE_WRITEONCE, "pintool", "falu_lat",    "4", "FP ALU latency");
-// FMUL latency:
-KNOB<UINT32> Knob_fmul_lat    (KNOB_MODE_WRITEONCE, "pintool", "fmul_lat",    "8", "FP multiplier latency");
-// FDIV latency:
-KNOB<UINT32> Knob_fdiv_lat    (KNOB_MODE_WRITEONCE, "pintool", "fdiv_lat",   "10", "FP divider latency");
-
-// ------------------------------------
-// Functional unit initiation intervals
-// ------------------------------------
-// Memory unit initiation interval:
-KNOB<UINT32> Knob_mem_ivl  (KNOB_MODE_WRITEONCE, "pintool", "mem_interval",  "1", "memory initiation interval");
-// IALU initiation interval:
-KNOB<UINT32> Knob_ialu_ivl (KNOB_MODE_WRITEONCE, "pintool", "ialu_interval", "1", "integer ALU initiation interval");
-// IMUL initiation interval:
-KNOB<UINT32> Knob_imul_ivl (KNOB_MODE_WRITEONCE, "pintool", "imul_interval", "1", "integer multiplier initiation interval");
-// IDIV initiation interval:
-KNOB<UINT32> Knob_idiv_ivl (KNOB_MODE_WRITEONCE, "pintool", "idiv_interval", "4", "integer divider initiation interval");
-// FALU initiation interval:
-KNOB<UINT32> Knob_falu_ivl (KNOB_MODE_WRITEONCE, "pintool", "falu_interval", "1", "FP ALU initiation interval");
-// FMUL initiation interval:
-KNOB<UINT32> Knob_fmul_ivl (KNOB_MODE_WRITEONCE, "pintool", "fmul_interval", "2", "FP multiplier initiation interval");
-// FDIV initiation interval:
-KNOB<UINT32> Knob_fdiv_ivl (KNOB_MODE_WRITEONCE, "pintool", "fdiv_interval", "5", "FP divider initiation interval");
+// The configuration of the core, given to sim_create(). The parameters and their
+//   meaning are listed in sim_params.def.
+sim_config g_params;
 
 // ---------------------------------------------------------------------------
 // --------------------------------- GLOBALS -----------------------------------
@@ -304,49 +276,337 @@ UINT64 g_fastFwdSim,  //Number of remaining instructions to fast-forward
 //  e.g. instructions written back (to calculate CPI)
 // ---------------------------------------------------------
 // ---------------------------------------------------------
+UINT64 g_instructions_dispatched,  // instructions dispatched after warm-up
+       g_instructions_wb;          // instructions which wrote their result after warm-up
+bool   g_sim_finished;             // set when the detailed simulation cycles are exhausted
+bool   g_sim_exited;               // sim_exit() has run for this simulation
+UINT64 g_stall_rs_full,            // Dispatch stall cycles by reason, after warm-up (all threads)
+       g_stall_no_preg;
+UINT64 g_seq;                      // Sequence number of the next dispatched instruction
+
+// Called for every pipeline event when set: stage is 'D' (dispatch), 'E' (execution
+//   starts) or 'W' (result written). Used to record and compare cycle timelines (sim_check).
+sim_event_fn g_event_hook = NULL;
+void        *g_event_ctx;
+
+// Called by sim_exit() when set (see sim_set_finish_callback())
+sim_finish_fn g_finish_fn;
+void         *g_finish_ctx;
+
+sim_core g_core;   // The only core (see sim_create())
+
+string g_sim_error;   // Why sim_init() or an API call failed
+
+// ---------------------------- SMT -------------------------------------
+enum SMT_FETCH_POLICY { SMT_FETCH_RR, SMT_FETCH_ICOUNT };
+enum SMT_RS_PART      { SMT_RS_SHARED, SMT_RS_STATIC };
+
+UINT32           g_num_threads;    // Number of hardware thread contexts (1 without SMT)
+SMT_FETCH_POLICY g_smt_fetch;
+SMT_RS_PART      g_smt_rs_part;
+UINT32           g_smt_rr_next;    // First thread considered by the round-robin policy
+
+// One uop queue per thread context, filled by the application threads and drained
+//   by the simulation thread. Empty when SMT is disabled.
+std::vector<SmtQueue *> g_smt_queues;
+
+std::vector<UINT32> g_thread_icount;      // Instructions of each thread in the RS pools (for ICOUNT)
+std::vector<UINT64> g_thread_dispatched;  // Per-thread statistics, after warm-up
+std::vector<UINT64> g_thread_wb;
+std::vector<UINT64> g_thread_stalls;      // Cycles a thread had a uop queued but dispatched nothing
+std::vector<UINT32> g_smt_blocked;        // Per-cycle scratch: why the thread's next uop cannot dispatch (DISPATCH_STALL)
+std::vector<bool>   g_smt_waiting;        // Per-cycle scratch: thread had a uop queued at the start of the cycle
+std::vector<UINT32> g_smt_dispatched;     // Per-cycle scratch: uops dispatched by each thread
+
+// ------------------------- Front-end ----------------------------------
+bool   g_fe_enabled;      // The front-end limits are modelled (see sim_fetch())
+bool   g_fusion;          // The instrumentation fuses cmp/test+jcc and load+op
+UINT64 g_fe_cycle;        // Cycle the front-end counters below refer to
+UINT32 g_fe_bytes;        // Instruction bytes fetched in g_fe_cycle
+UINT32 g_fe_slots;        // Decode slots used in g_fe_cycle
+
+// Set-associative uop cache with LRU replacement. An entry holds the decoded uops of the
+//   instruction at address tag; only the tags are modelled.
+struct UopCacheEntry {
+	UINT64 tag;
+	UINT64  last_use;
+	bool    valid;
+};
+std::vector<UopCacheEntry> g_uc;   // uop_cache_sets * uop_cache_ways entries, set by set
+UINT32 g_uc_set_mask;
+UINT32 g_uc_ways;
+UINT64 g_uc_tick;                  // LRU clock
+
+UINT64 g_fe_stall_cycles,   // Cycles ended early because fetch or decode bandwidth ran out, after warm-up
+       g_uc_hits,
+       g_uc_misses,
+       g_fused_macro,       // Dynamic cmp/test+jcc pairs dispatched as one uop
+       g_fused_load_op;     // Dynamic load+op instructions decoded in one slot
+
+
+// ------------------------- Core variants ------------------------------
+// The simulation core (sim_uop_t() and the stage functions) is a template over a CORE class
+//   which supplies the machine parameters read on every cycle. GenericCore reads them from
+//   the knobs, cached in g_cfg at sim_init(). FixedCore makes them compile-time constants,
+//   so the compiler can unroll the FU/CDB loops and drop the debugging code entirely.
+struct SimConfig {
+	UINT32 disp_width;
+	UINT32 cdb_width;
+	UINT32 verbose;
+	UINT32 fetch_bytes;    // Front-end (see sim_fetch_t())
+	UINT32 decode_width;
+};
+SimConfig g_cfg;
+
+struct GenericCore {
+	static inline UINT32 disp_width()       { return g_cfg.disp_width; }
+	static inline UINT32 cdb_width()        { return g_cfg.cdb_width; }
+	static inline UINT32 verbose()          { return g_cfg.verbose; }
+	static inline UINT32 num_fus(UINT32 fu) { return rs_fu[fu]->num_fus; }
+	static inline UINT32 num_rs(UINT32 fu)  { return rs_fu[fu]->num_rs; }
+};
+
+// Parameters are: dispatch width, CDB width, debugging messages (false: compiled out, -verb 0),
+//   number of FUs and number of RS per type (MEMOP, IALU, IMUL, IDIV, FALU, FMUL, FDIV).
+template<UINT32 DISP, UINT32 CDB, bool VERB,
+	UINT32 F_MEM, UINT32 F_IALU, UINT32 F_IMUL, UINT32 F_IDIV, UINT32 F_FALU, UINT32 F_FMUL, UINT32 F_FDIV,
+	UINT32 R_MEM, UINT32 R_IALU, UINT32 R_IMUL, UINT32 R_IDIV, UINT32 R_FALU, UINT32 R_FMUL, UINT32 R_FDIV>
+struct FixedCore {
+	// The same machine with the debugging messages of any other -verb level
+	typedef FixedCore<DISP, CDB, true, F_MEM, F_IALU, F_IMUL, F_IDIV, F_FALU, F_FMUL, F_FDIV,
+		R_MEM, R_IALU, R_IMUL, R_IDIV, R_FALU, R_FMUL, R_FDIV> Verbose;
+
+	static inline UINT32 disp_width() { return DISP; }
+	static inline UINT32 cdb_width()  { return CDB; }
+	static inline UINT32 verbose()    { return VERB? g_cfg.verbose : 0; }
+	static inline UINT32 num_fus(UINT32 fu) {
+		switch (fu) {
+			case MEMOP: return F_MEM;
+			case IALU:  return F_IALU;
+			case IMUL:  return F_IMUL;
+			case IDIV:  return F_IDIV;
+			case FALU:  return F_FALU;
+			case FMUL:  return F_FMUL;
+			default:    return F_FDIV;
+		}
+	}
+	static inline UINT32 num_rs(UINT32 fu) {
+		switch (fu) {
+			case MEMOP: return R_MEM;
+			case IALU:  return R_IALU;
+			case IMUL:  return R_IMUL;
+			case IDIV:  return R_IDIV;
+			case FALU:  return R_FALU;
+			case FMUL:  return R_FMUL;
+			default:    return R_FDIV;
+		}
+	}
+	// True if the knobs describe exactly this machine
+	static bool matches() {
+		return (g_params.disp_width == DISP) && (g_params.cdb_width == CDB)
+			&& (g_params.num_mem   == F_MEM)  && (g_params.num_rs_mem  == R_MEM)
+			&& (g_params.num_ialus == F_IALU) && (g_params.num_rs_ialu == R_IALU)
+			&& (g_params.num_imuls == F_IMUL) && (g_params.num_rs_imul == R_IMUL)
+			&& (g_params.num_idivs == F_IDIV) && (g_params.num_rs_idiv == R_IDIV)
+			&& (g_params.num_falus == F_FALU) && (g_params.num_rs_falu == R_FALU)
+			&& (g_params.num_fmuls == F_FMUL) && (g_params.num_rs_fmul == R_FMUL)
+			&& (g_params.num_fdivs == F_FDIV) && (g_params.num_rs_fdiv == R_FDIV);
+	}
+};
+
+// Standard machine configurations, without debugging messages (Core_Nw::Verbose has them).
+//                disp cdb verb   mem ialu imul idiv falu fmul fdiv   RS: mem ialu imul idiv falu fmul fdiv
+typedef FixedCore<1,   1,  false, 1,  1,   1,   1,   1,   1,   1,        1,  1,   1,   1,   1,   1,   1> Core_1w;
+typedef FixedCore<2,   2,  false, 1,  2,   1,   1,   1,   1,   1,        4,  8,   2,   2,   4,   4,   2> Core_2w;
+typedef FixedCore<4,   4,  false, 2,  4,   1,   1,   2,   2,   1,        8,  16,  4,   4,   8,   8,   4> Core_4w;
+typedef FixedCore<8,   8,  false, 4,  6,   2,   1,   4,   4,   1,        32, 48,  8,   4,   32,  32,  8> Core_8w;
+
+template<class CORE> void sim_uop_t(UINT32 uop_opcode, UINT32 src1, UINT32 src2, UINT32 src3, UINT32 dst);
+template<class CORE> void sim_drain_t();
+template<class CORE> void sim_advance_t(UINT64 cycles);
+template<class CORE> void sim_fetch_t(UINT64 pc, UINT32 size, UINT32 slots, UINT32 fused);
+void sim_uop_dataflow(UINT32 uop_opcode, UINT32 src1, UINT32 src2, UINT32 src3, UINT32 dst);
+void sim_drain_dataflow();
+void sim_advance_dataflow(UINT64 cycles);
+
+// Registry of pre-instantiated cores, searched in order at sim_init()
+struct CoreFuncs {
+	SIM_UOP_FUNC   sim_uop;
+	void          (*sim_drain)();
+	void          (*sim_advance)(UINT64 cycles);
+	SIM_FETCH_FUNC sim_fetch;
+};
+#define CORE_FUNCS(C) { sim_uop_t<C>, sim_drain_t<C>, sim_advance_t<C>, sim_fetch_t<C> }
+struct CoreVariant {
+	const char *name;
+	bool      (*matches)();
+	CoreFuncs   quiet;     // -verb 0
+	CoreFuncs   verbose;   // Any other -verb level
+};
+const CoreVariant g_core_variants[] = {
+	{ "1w", Core_1w::matches, CORE_FUNCS(Core_1w), CORE_FUNCS(Core_1w::Verbose) },
+	{ "2w", Core_2w::matches, CORE_FUNCS(Core_2w), CORE_FUNCS(Core_2w::Verbose) },
+	{ "4w", Core_4w::matches, CORE_FUNCS(Core_4w), CORE_FUNCS(Core_4w::Verbose) },
+	{ "8w", Core_8w::matches, CORE_FUNCS(Core_8w), CORE_FUNCS(Core_8w::Verbose) },
+};
+
+// The core which simulates every uop: one of g_core_variants, or sim_uop_t<GenericCore>
+SIM_UOP_FUNC   g_sim_uop;
+void         (*g_sim_drain)();
+void         (*g_sim_advance)(UINT64 cycles);
+SIM_FETCH_FUNC g_sim_fetch;
+const char  *g_core_name;
+
+// ------------------------- Clusters ------------------------------------
+enum CLUSTER_STEER { STEER_DEP, STEER_BALANCE };
+UINT32              g_num_clusters;
+CLUSTER_STEER       g_cluster_steer;
+UINT32              g_cluster_bypass;
+std::vector<UINT32> g_cluster_rs;         // RS occupied in each cluster, over all FU types
+std::vector<UINT64> g_cluster_occupancy;  // Sum over the cycles of g_cluster_rs, after warm-up
+std::vector<UINT64> g_cluster_steered;    // Uops steered to each cluster, after warm-up
+UINT64              g_cluster_wakeups,    // Operands delivered on the CDB, after warm-up
+                    g_cluster_cross;      //   of which to another cluster
+
+// ------------------------- CDB arbitration -----------------------------
+enum CDB_POLICY { CDB_DUE, CDB_OLDEST, CDB_FU, CDB_LATENCY };
+CDB_POLICY                 g_cdb_policy;
+bool                       g_cdb_arbitrate;      // Not the default policy: use arbitrate_cdb()
+UINT32                     g_cdb_fu_rank[LAST_FU]; // Priority of each FU type, 0 highest
+UINT32                     g_fu_out_buf;         // Output buffer entries per FU
+std::vector<EventQ_Item *> g_cdb_waiting;        // Due results which have not won a CDB yet (arbitrate_cdb())
+UINT64 g_cdb_conflicts,     // Cycles with more results due than CDBs, after warm-up
+       g_cdb_wait_cycles,   // Cycles results spent waiting for a CDB after they were due, after warm-up
+       g_fu_backpressure;   // Unit-cycles a unit could not start because its output buffer was full, after warm-up
+
+// ------------------------- Dataflow limit ------------------------------
+// -core dataflow replaces the cycle loop by the completion time of each uop: the latest
+//   completion of its sources plus its FU latency. g_cycle is the critical path length.
+bool                g_dataflow;       // -core dataflow
+std::vector<UINT64> g_df_ready;       // Per register: cycle its latest value is produced
+std::vector<UINT64> g_df_retire;      // Ring of the retire cycles of the last dataflow_window uops
+UINT32              g_df_next;        // Oldest entry of g_df_retire
+UINT64              g_df_last_retire; // Retire cycle of the youngest uop (retirement is in order)
+
+// ------------------------- Speculative scheduling ------------------------
+// The execution of an instruction starts g_sched_depth cycles after its selection. Without
+//   speculative wakeup its dependents are selected when its result is written on the CDB, so
+//   they execute g_sched_depth cycles later. With it, they are selected when they can execute
+//   as the result arrives, assuming its FU latency; if it is late they issue without their
+//   operand and are replayed. The model has no separate select stage: g_cycle is the cycle of
+//   execution, the scheduling loop delays the ready_cycle of the dependents.
+UINT32 g_sched_depth;
+bool   g_spec_wakeup;
+UINT32 g_load_miss_acc;   // Spreads load_miss_pct evenly over the loads, in program order
+UINT64 g_issued,          // Issue slots used, including the replayed ones, after warm-up
+       g_replay_miss,     // Replayed issues, after warm-up, by cause: a source is a load which missed,
+       g_replay_chain,    //   a source's own issue was replayed,
+       g_replay_late,     //   a source result waited for a CDB
+       g_loads,           // Loads dispatched after warm-up, with load_miss_pct
+       g_load_misses;
+
+// Host time spent simulating, to compare core variants (see print_stats())
+struct timeval g_host_start;
+
+// Host seconds since sim_init()
+double host_seconds()
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - g_host_start.tv_sec) + (now.tv_usec - g_host_start.tv_usec) / 1e6;
+}
+
+// ------------------------- Telemetry ----------------------------------
+SimTelemetry *g_telemetry = NULL;  // The mapped segment, NULL without -telemetry
+UINT64 g_telemetry_next;           // Cycle of the next update; never reached without telemetry
+UINT64 g_telemetry_last_seq;       // g_seq and host time at the previous update, for uops/sec
+double g_telemetry_last_secs;
+
+// ------------------------- Pipeline event log ---------------------------
+FILE  *g_pipeview = NULL;              // The log file, NULL without -pipeview
+std::vector<SimPipeviewRec> g_pv_buf;  // Records not written to the file yet
+UINT32 g_pv_count;                     // Records in g_pv_buf
+UINT64 g_pv_logged;                    // Records logged in all
+std::vector<UINT32> g_uop_stall;         // Per thread: why its next uop waits to dispatch (DISPATCH_STALL)
+std::vector<UINT32> g_uop_stall_cycles;  //   and for how many cycles it has waited
 
 
 // -------------------------------------------------------------------------------
 // --------------------------------- FUNCTIONS -----------------------------------
 // -------------------------------------------------------------------------------
-void run_Execute_stage();
-void run_WriteResult_stage();
+template<class CORE> void run_Execute_stage();
+template<class CORE> void run_WriteResult_stage();
+bool telemetry_open();
+void telemetry_publish(bool finished);
+bool pipeview_open();
+void pipeview_flush();
+void sim_fini();
+
+// Record why the configuration cannot be simulated. Returns false, for sim_init() to return.
+bool sim_error(const string &msg)
+{
+	g_sim_error = msg;
+	return false;
+}
+
+// The handle of an API call must be the core sim_create() returned, not yet destroyed.
+//   Returns false, with the reason in g_sim_error, otherwise.
+bool valid_core(const sim_core *core)
+{
+	if ((core == &g_core) && g_core.created)
+		return true;
+	return sim_error("invalid core handle");
+}
 
-void sim_init()
+// The register numbers of a uop must be below num_regs, the size of the per-register
+//   tables. Returns false, with the reason in g_sim_error, otherwise.
+bool valid_uop(const sim_uop_rec &uop)
+{
+	UINT32 regs = g_params.num_regs;
+	if ((uop.src1 < regs) && (uop.src2 < regs) && (uop.src3 < regs) && (uop.dst < regs))
+		return true;
+	std::ostringstream msg;
+	msg << "register number of " << sim_opcode_name(uop.opcode) << " uop not below num_regs (" << regs << ")";
+	return sim_error(msg.str());
+}
+
+// Set up the core for the configuration in g_params. Returns false, with the reason in
+//   g_sim_error, if the configuration is invalid; sim_fini() must still be called.
+bool sim_init()
 {
 	// --------------------------------------------------------------------------
 	// Initialise data structures and counters here.
 	// --------------------------------------------------------------------------
-	rs_fu[MEMOP] = new ResStationFuncUnit(MEMOP, Knob_num_mem.Value(), Knob_num_rs_mem.Value(),
-			Knob_mem_pdepth.Value(), Knob_mem_ivl.Value(),
-			Knob_mem_add_lat.Value());
-	rs_fu[IALU]  = new ResStationFuncUnit(IALU, Knob_num_ialus.Value(), Knob_num_rs_ialu.Value(),
-			Knob_ialu_pdepth.Value(), Knob_ialu_ivl.Value(),
-			Knob_ialu_lat.Value());
-	rs_fu[IMUL]  = new ResStationFuncUnit(IMUL, Knob_num_imuls.Value(), Knob_num_rs_imul.Value(),
-			Knob_ialu_pdepth.Value(), Knob_imul_ivl.Value(),
-			Knob_imul_lat.Value());
-	rs_fu[IDIV]  = new ResStationFuncUnit(IDIV, Knob_num_idivs.Value(), Knob_num_rs_idiv.Value(),
-			Knob_ialu_pdepth.Value(), Knob_idiv_ivl.Value(),
-			Knob_idiv_lat.Value());
-	rs_fu[FALU]  = new ResStationFuncUnit(FALU, Knob_num_falus.Value(), Knob_num_rs_falu.Value(),
-			Knob_ialu_pdepth.Value(), Knob_falu_ivl.Value(),
-			Knob_falu_lat.Value());
-	rs_fu[FMUL]  = new ResStationFuncUnit(FMUL, Knob_num_fmuls.Value(), Knob_num_rs_fmul.Value(),
-			Knob_ialu_pdepth.Value(), Knob_fmul_ivl.Value(),
-			Knob_fmul_lat.Value());
-	rs_fu[FDIV]  = new ResStationFuncUnit(FDIV, Knob_num_fdivs.Value(), Knob_num_rs_fdiv.Value(),
-			Knob_ialu_pdepth.Value(), Knob_fdiv_ivl.Value(),
-			Knob_fdiv_lat.Value());
+	rs_fu[MEMOP] = new ResStationFuncUnit(MEMOP, g_params.num_mem, g_params.num_rs_mem,
+			g_params.mem_pdepth, g_params.mem_ivl,
+			g_params.mem_add_lat);
+	rs_fu[IALU]  = new ResStationFuncUnit(IALU, g_params.num_ialus, g_params.num_rs_ialu,
+			g_params.ialu_pdepth, g_params.ialu_ivl,
+			g_params.ialu_lat);
+	rs_fu[IMUL]  = new ResStationFuncUnit(IMUL, g_params.num_imuls, g_params.num_rs_imul,
+			g_params.ialu_pdepth, g_params.imul_ivl,
+			g_params.imul_lat);
+	rs_fu[IDIV]  = new ResStationFuncUnit(IDIV, g_params.num_idivs, g_params.num_rs_idiv,
+			g_params.ialu_pdepth, g_params.idiv_ivl,
+			g_params.idiv_lat);
+	rs_fu[FALU]  = new ResStationFuncUnit(FALU, g_params.num_falus, g_params.num_rs_falu,
+			g_params.ialu_pdepth, g_params.falu_ivl,
+			g_params.falu_lat);
+	rs_fu[FMUL]  = new ResStationFuncUnit(FMUL, g_params.num_fmuls, g_params.num_rs_fmul,
+			g_params.ialu_pdepth, g_params.fmul_ivl,
+			g_params.fmul_lat);
+	rs_fu[FDIV]  = new ResStationFuncUnit(FDIV, g_params.num_fdivs, g_params.num_rs_fdiv,
+			g_params.ialu_pdepth, g_params.fdiv_ivl,
+			g_params.fdiv_lat);
 //	cout << "REG_LAST: " << REG_LAST  << endl ;
 	g_cycle = 0;
 	g_dispatch_count = 0;
 	g_is_new_cycle = false;
 	g_last = 0;
-	g_fastFwdSim  = Knob_num_ff.Value();        // Number of instructions to fast-forward
+	g_fastFwdSim  = g_params.num_ff;        // Number of instructions to fast-forward
 	g_cycle_start = 0;
-	g_detailedSim = Knob_num_detailed.Value();  // Number of detailed simulation cycles (including warm-up)
-	g_warmUpSim   = Knob_num_warmUp.Value();    // Number of warmup cycles
+	g_detailedSim = g_params.num_detailed;  // Number of detailed simulation cycles (including warm-up)
+	g_warmUpSim   = g_params.num_warmup;    // Number of warmup cycles
 	if (g_detailedSim < g_warmUpSim)
 		g_detailedSim = g_warmUpSim;
 
@@ -355,27 +615,458 @@ void sim_init()
 	// Initialize any other globals needed for counting interesting events,
 	// ---------------------------------------------------------
 	// ---------------------------------------------------------
-	return;
+	g_instructions_dispatched = 0;
+	g_instructions_wb = 0;
+	g_sim_finished = false;
+	g_sim_exited = false;
+	g_seq = 0;
+
+	g_cfg.disp_width = g_params.disp_width;
+	g_cfg.cdb_width  = g_params.cdb_width;
+	g_cfg.verbose    = g_params.verbose;
+	g_cfg.fetch_bytes  = g_params.fetch_bytes;
+	g_cfg.decode_width = g_params.decode_width;
+
+	// Select a core specialized for this configuration, if one was compiled in.
+	//   SMT always runs on the generic core.
+	g_sim_uop   = sim_uop_t<GenericCore>;
+	g_sim_drain = sim_drain_t<GenericCore>;
+	g_sim_advance = sim_advance_t<GenericCore>;
+	g_sim_fetch = sim_fetch_t<GenericCore>;
+	g_core_name = "generic";
+	if ((string(g_params.core) == "auto") && (g_params.smt == 0)) {
+		for (UINT32 v = 0; v < sizeof(g_core_variants) / sizeof(g_core_variants[0]); v++) {
+			if (g_core_variants[v].matches()) {
+				const CoreFuncs &f = (g_params.verbose == 0)? g_core_variants[v].quiet : g_core_variants[v].verbose;
+				g_sim_uop   = f.sim_uop;
+				g_sim_drain = f.sim_drain;
+				g_sim_advance = f.sim_advance;
+				g_sim_fetch = f.sim_fetch;
+				g_core_name = g_core_variants[v].name;
+				break;
+			}
+		}
+	} else if (string(g_params.core) == "dataflow") {
+		if (g_params.smt > 0) {
+			return sim_error("the dataflow core does not support SMT");
+		}
+		g_sim_uop   = sim_uop_dataflow;
+		g_sim_drain = sim_drain_dataflow;
+		g_sim_advance = sim_advance_dataflow;
+		g_core_name = "dataflow";
+	} else if ((string(g_params.core) != "generic") && (string(g_params.core) != "auto")) {   // auto with SMT: generic
+		return sim_error(string("unknown core: ") + g_params.core);
+	}
+	g_dataflow = (string(g_params.core) == "dataflow");
+	g_df_ready.assign(g_params.num_regs, 0);
+	g_df_retire.assign(g_dataflow? g_params.df_window : 0, 0);
+	g_df_next = 0;
+	g_df_last_retire = 0;
+	if (g_dataflow)   // There is no state to warm up: every uop is measured
+		g_warmUpSim = 0;
+	gettimeofday(&g_host_start, NULL);
+
+	// SMT: one rename table, RS share and statistics set per hardware thread context
+	g_num_threads = (g_params.smt > 0)? g_params.smt : 1;
+	registerStatus.assign(g_num_threads, std::vector<ReservationStation *>(1, NULL));
+	g_reg_slot.assign(g_params.num_regs, 0);
+	g_reg_class.assign(g_params.num_regs, RC_LAST);
+
+	g_num_clusters   = (g_params.clusters > 0)? g_params.clusters : 1;
+	g_cluster_bypass = g_params.cluster_bypass;
+	if (string(g_params.cluster_steer) == "dep")
+		g_cluster_steer = STEER_DEP;
+	else if (string(g_params.cluster_steer) == "balance")
+		g_cluster_steer = STEER_BALANCE;
+	else {
+		return sim_error(string("unknown cluster steering policy: ") + g_params.cluster_steer);
+	}
+	for (int i = MEMOP; i < LAST_FU; i++) {
+		ResStationFuncUnit *rsfu = rs_fu[i];
+		rsfu->num_clusters     = std::min(rsfu->num_fus, g_num_clusters);
+		rsfu->rs_cluster_share.assign(g_num_clusters, 0);
+		for (UINT32 c = 0; c < rsfu->num_clusters; c++)
+			rsfu->rs_cluster_share[c] = rsfu->num_rs / rsfu->num_clusters + ((c < rsfu->num_rs % rsfu->num_clusters)? 1 : 0);
+		rsfu->rs_per_cluster.assign(g_num_clusters, 0);
+	}
+	g_cluster_rs.assign(g_num_clusters, 0);
+	g_cluster_occupancy.assign(g_num_clusters, 0);
+	g_cluster_steered.assign(g_num_clusters, 0);
+	g_cluster_wakeups = 0;
+	g_cluster_cross = 0;
+
+	if (string(g_params.cdb_policy) == "due")
+		g_cdb_policy = CDB_DUE;
+	else if (string(g_params.cdb_policy) == "oldest")
+		g_cdb_policy = CDB_OLDEST;
+	else if (string(g_params.cdb_policy) == "fu")
+		g_cdb_policy = CDB_FU;
+	else if (string(g_params.cdb_policy) == "latency")
+		g_cdb_policy = CDB_LATENCY;
+	else {
+		return sim_error(string("unknown CDB policy: ") + g_params.cdb_policy);
+	}
+	const char *fu_names[LAST_FU] = { "", "mem", "ialu", "imul", "idiv", "falu", "fmul", "fdiv" };
+	string order = string(g_params.cdb_fu_order) + ",";
+	UINT32 rank = 0;
+	for (int i = MEMOP; i < LAST_FU; i++)
+		g_cdb_fu_rank[i] = LAST_FU;   // Types not listed come last
+	for (size_t pos = 0, comma; (comma = order.find(',', pos)) != string::npos; pos = comma + 1) {
+		string name = order.substr(pos, comma - pos);
+		int i = MEMOP;
+		while ((i < LAST_FU) && (name != fu_names[i]))
+			i++;
+		if (i == LAST_FU) {
+			return sim_error(string("unknown FU type in cdb_fu_order: ") + name);
+		}
+		g_cdb_fu_rank[i] = rank++;
+	}
+	g_fu_out_buf    = g_params.fu_out_buf;
+	g_cdb_arbitrate = (g_cdb_policy != CDB_DUE) || (g_fu_out_buf > 0);
+	g_cdb_waiting.clear();
+	g_cdb_conflicts   = 0;
+	g_cdb_wait_cycles = 0;
+	g_fu_backpressure = 0;
+	g_num_pregs[RC_INT] = g_params.phys_int;
+	g_num_pregs[RC_FP]  = g_params.phys_fp;
+	for (UINT32 c = 0; c < RC_LAST; c++) {
+		g_free_pregs[c].clear();
+		for (UINT32 p = g_num_pregs[c]; p > 0; p--)
+			g_free_pregs[c].push_back(p - 1);
+	}
+	g_stall_rs_full = 0;
+	g_stall_no_preg = 0;
+	for (int i = MEMOP; i < LAST_FU; i++)
+		rs_fu[i]->rs_per_thread.assign(g_num_threads, 0);
+	g_thread_icount.assign(g_num_threads, 0);
+	g_thread_dispatched.assign(g_num_threads, 0);
+	g_thread_wb.assign(g_num_threads, 0);
+	g_thread_stalls.assign(g_num_threads, 0);
+	g_smt_blocked.assign(g_num_threads, STALL_NONE);
+	g_smt_waiting.assign(g_num_threads, false);
+	g_smt_dispatched.assign(g_num_threads, 0);
+	g_smt_rr_next = 0;
+
+	if (string(g_params.smt_fetch) == "rr")
+		g_smt_fetch = SMT_FETCH_RR;
+	else if (string(g_params.smt_fetch) == "icount")
+		g_smt_fetch = SMT_FETCH_ICOUNT;
+	else {
+		return sim_error(string("unknown SMT fetch policy: ") + g_params.smt_fetch);
+	}
+	if (string(g_params.smt_rs_part) == "shared")
+		g_smt_rs_part = SMT_RS_SHARED;
+	else if (string(g_params.smt_rs_part) == "static")
+		g_smt_rs_part = SMT_RS_STATIC;
+	else {
+		return sim_error(string("unknown SMT RS partitioning: ") + g_params.smt_rs_part);
+	}
+
+	if (g_params.smt > 0) {
+		UINT32 qsize = g_params.smt_queue;
+		if ((qsize == 0) || ((qsize & (qsize - 1)) != 0)) {
+			return sim_error("smt_queue must be a power of 2");
+		}
+		for (UINT32 t = 0; t < g_num_threads; t++)
+			g_smt_queues.push_back(new SmtQueue(qsize));
+	}
+
+	// Front-end
+	g_fusion     = g_params.fusion && (g_params.smt == 0);
+	g_fe_enabled = ((g_params.fetch_bytes > 0) || (g_params.decode_width > 0) || (g_params.uc_sets > 0))
+	               && (g_params.smt == 0) && !g_dataflow;
+	g_fe_cycle = 0;
+	g_fe_bytes = 0;
+	g_fe_slots = 0;
+	UINT32 uc_sets = g_params.uc_sets;
+	if ((uc_sets & (uc_sets - 1)) != 0) {
+		return sim_error("uop_cache_sets must be a power of 2");
+	}
+	g_uc_ways     = (uc_sets > 0)? g_params.uc_ways : 0;
+	g_uc_set_mask = (uc_sets > 0)? uc_sets - 1 : 0;
+	UopCacheEntry invalid = { 0, 0, false };
+	g_uc.assign(uc_sets * g_uc_ways, invalid);
+	g_uc_tick = 0;
+	g_fe_stall_cycles = 0;
+	g_uc_hits = 0;
+	g_uc_misses = 0;
+	g_fused_macro = 0;
+	g_fused_load_op = 0;
+
+	g_telemetry_next = (UINT64) -1;
+	if (g_params.telemetry[0] != '\0') {
+		if (g_params.telemetry_interval == 0) {
+			return sim_error("telemetry_interval must be at least 1");
+		}
+		if (!telemetry_open())
+			return false;
+		telemetry_publish(false);
+	}
+
+	g_sched_depth = g_params.sched_depth;
+	g_spec_wakeup = g_params.spec_wakeup;
+	if (g_params.load_miss_pct > 100) {
+		return sim_error("load_miss_pct must be at most 100");
+	}
+	g_load_miss_acc = 0;
+	g_issued = 0;
+	g_replay_miss = 0;
+	g_replay_chain = 0;
+	g_replay_late = 0;
+	g_loads = 0;
+	g_load_misses = 0;
+
+	g_uop_stall.assign(g_num_threads, STALL_NONE);
+	g_uop_stall_cycles.assign(g_num_threads, 0);
+	g_pv_count  = 0;
+	g_pv_logged = 0;
+	if (g_params.pipeview[0] != '\0') {
+		if (g_dataflow) {
+			return sim_error("the dataflow core has no pipeline to log");
+		}
+		if (g_params.pipeview_sample == 0) {
+			return sim_error("pipeview_sample must be at least 1");
+		}
+		if (!pipeview_open())
+			return false;
+	}
+	return true;
 }
 
 
-void print_stats()
+// Create the telemetry segment. A file in /dev/shm is the POSIX shared-memory object of the
+//   same name (shm_open() would need librt, which Pin's runtime does not provide).
+bool telemetry_open()
 {
-	TraceFile << "Fast-forwarded instructions: "                << Knob_num_ff.Value() << endl;
-	TraceFile << "Detailed simulation cycles (incl. warm-up): " << Knob_num_detailed.Value() << endl;
-	TraceFile << "Warm-up cycles: "                             << Knob_num_warmUp.Value() << endl;
-	TraceFile << "Number of (measure) cycles: "                 << g_cycle - g_cycle_start << endl;
+	string name = string(g_params.telemetry);
+	if (name[0] == '/')
+		name = name.substr(1);
+	string path = "/dev/shm/" + name;
+	int fd = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if ((fd < 0) || (ftruncate(fd, sizeof(SimTelemetry)) != 0)) {
+		return sim_error(string("cannot create telemetry segment ") + path);
+	}
+	void *p = mmap(NULL, sizeof(SimTelemetry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return sim_error(string("cannot map telemetry segment ") + path);
+	}
+	g_telemetry = (SimTelemetry *) p;
+	g_telemetry->magic   = SIM_TELEMETRY_MAGIC;
+	g_telemetry->version = SIM_TELEMETRY_VERSION;
+	g_telemetry->pid     = getpid();
+	g_telemetry_last_seq  = 0;
+	g_telemetry_last_secs = 0;
+	return true;
+}
+
+// Publish the statistics. Called from advance_cycle() every telemetry_interval cycles,
+//   so the per-uop path only pays for one comparison.
+void telemetry_publish(bool finished)
+{
+	SimTelemetry *t = g_telemetry;
+	double secs = host_seconds();
+	UINT64 cycles = g_cycle - g_cycle_start;
+
+	// Seqlock write: readers retry while seq is odd or has changed
+	__atomic_store_n(&t->seq, t->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	t->cycle             = g_cycle;
+	t->measured_cycles   = cycles;
+	t->uops_dispatched   = g_instructions_dispatched;
+	t->uops_wb           = g_instructions_wb;
+	t->ipc               = (cycles > 0)? (double) g_instructions_wb / cycles : 0.0;
+	t->stall_rs_full     = g_stall_rs_full;
+	t->stall_no_preg     = g_stall_no_preg;
+	t->stall_frontend    = g_fe_stall_cycles;
+	t->host_seconds      = secs;
+	t->host_uops_per_sec = (secs > g_telemetry_last_secs)? (g_seq - g_telemetry_last_seq) / (secs - g_telemetry_last_secs) : 0.0;
+	t->warming_up        = (g_warmUpSim > 0);
+	t->finished          = finished;
+	__atomic_store_n(&t->seq, t->seq + 1, __ATOMIC_RELEASE);
+
+	g_telemetry_last_seq  = g_seq;
+	g_telemetry_last_secs = secs;
+	g_telemetry_next      = g_cycle + g_params.telemetry_interval;
+}
+
+// Create the pipeline log and write its header. Records are collected in g_pv_buf and
+//   written a buffer at a time.
+bool pipeview_open()
+{
+	g_pipeview = fopen(g_params.pipeview, "wb");
+	if (g_pipeview == NULL) {
+		return sim_error(string("cannot create pipeline log ") + g_params.pipeview);
+	}
+	SimPipeviewHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic    = SIM_PIPEVIEW_MAGIC;
+	h.version  = SIM_PIPEVIEW_VERSION;
+	h.rec_size = sizeof(SimPipeviewRec);
+	h.sample   = g_params.pipeview_sample;
+	h.start    = g_params.pipeview_start;
+	h.end      = g_params.pipeview_end;
+	fwrite(&h, sizeof(h), 1, g_pipeview);
+	g_pv_buf.resize(4096);
+	return true;
+}
+
+// Write the buffered records to the log
+void pipeview_flush()
+{
+	if (g_pv_count > 0)
+		fwrite(&g_pv_buf[0], sizeof(SimPipeviewRec), g_pv_count, g_pipeview);
+	g_pv_count = 0;
+	fflush(g_pipeview);
+}
+
+// Log the lifetime of rs, whose result is written on the CDB in this cycle, if it is sampled
+//   and was dispatched in the cycle window. due is the cycle it left the FU pipeline.
+void pipeview_record(const ReservationStation *rs, UINT64 due)
+{
+	if ((rs->seq % g_params.pipeview_sample != 0) || (rs->dispatch_cycle < g_params.pipeview_start)
+	|| ((g_params.pipeview_end > 0) && (rs->dispatch_cycle >= g_params.pipeview_end)))
+		return;
+	SimPipeviewRec &r = g_pv_buf[g_pv_count];
+	r.seq          = rs->seq;
+	r.dispatch     = rs->dispatch_cycle;
+	r.issue        = rs->issue_cycle;
+	r.complete     = due;
+	r.writeback    = g_cycle;
+	r.src1         = rs->srcReg1;
+	r.src2         = rs->srcReg2;
+	r.src3         = rs->srcReg3;
+	r.dst          = rs->dstReg;
+	r.stall_cycles = rs->stall_cycles;
+	r.opcode       = rs->opCode;
+	r.stall        = rs->stall;
+	r.fu_num       = rs->fu_num;
+	r.tid          = rs->tid;
+	r.cluster      = rs->cluster;
+	r.replays      = rs->replays;
+	g_pv_logged++;
+	if (++g_pv_count == g_pv_buf.size())
+		pipeview_flush();
+}
+
+// Release the core's data structures (sim_destroy()), so that sim_init() can start a new simulation.
+void sim_fini()
+{
+	while (!g_eventQ.empty()) {
+		delete g_eventQ.top();
+		g_eventQ.pop();
+	}
+	for (UINT32 w = 0; w < g_cdb_waiting.size(); w++)
+		delete g_cdb_waiting[w];
+	g_cdb_waiting.clear();
+	for (int i = MEMOP; i < LAST_FU; i++) {
+		for (std::list<ReservationStation*>::iterator it = rs_fu[i]->rs_pool.begin(); it != rs_fu[i]->rs_pool.end(); it++)
+			delete *it;
+		delete rs_fu[i];
+		rs_fu[i] = NULL;
+	}
+	registerStatus.clear();
+	g_reg_slot.clear();
+	g_reg_class.clear();
+	if (g_telemetry != NULL) {
+		munmap(g_telemetry, sizeof(SimTelemetry));
+		g_telemetry = NULL;
+	}
+	if (g_pipeview != NULL) {
+		pipeview_flush();
+		fclose(g_pipeview);
+		g_pipeview = NULL;
+	}
+	g_pv_buf.clear();
+	for (UINT32 t = 0; t < g_smt_queues.size(); t++)
+		delete g_smt_queues[t];
+	g_smt_queues.clear();
+}
+
+
+// Write the statistics report (the Pin tool's output file)
+void print_stats(std::ostream &out)
+{
+	out << "Fast-forwarded instructions: "                << g_params.num_ff << endl;
+	out << "Detailed simulation cycles (incl. warm-up): " << g_params.num_detailed << endl;
+	out << "Warm-up cycles: "                             << g_params.num_warmup << endl;
+	out << "Number of (measure) cycles: "                 << g_cycle - g_cycle_start << endl;
 	// ---------------------------------------------------------
 	// ---------------------------------------------------------
 	// Add instructions to write the information you collect
 	//   during the simulation
 	// ---------------------------------------------------------
 	// ---------------------------------------------------------
+	UINT64 cycles = g_cycle - g_cycle_start;
+	double host_secs = host_seconds();
+	out << "Core: "                                       << g_core_name << endl;
+	out << "Host seconds: "                               << host_secs << endl;
+	out << "Simulated cycles per host second: "           << ((host_secs > 0)? g_cycle / host_secs : 0.0) << endl;
+	out << "Instructions dispatched: "                    << g_instructions_dispatched << endl;
+	out << "Instructions written back: "                  << g_instructions_wb << endl;
+	out << "IPC: " << ((cycles > 0)? (double) g_instructions_wb / cycles : 0.0) << endl;
+	if (!g_smt_queues.empty()) {
+		out << "SMT thread contexts: " << g_num_threads
+		          << " fetch: " << g_params.smt_fetch << " RS: " << g_params.smt_rs_part << endl;
+		for (UINT32 t = 0; t < g_num_threads; t++) {
+			out << "Thread " << t << ": dispatched: " << g_thread_dispatched[t]
+			          << " written back: "   << g_thread_wb[t]
+			          << " IPC: "            << ((cycles > 0)? (double) g_thread_wb[t] / cycles : 0.0)
+			          << " dispatch stall cycles: " << g_thread_stalls[t] << endl;
+		}
+	}
+	out << "Back-end stall cycles: RS full: " << g_stall_rs_full
+	          << " no free physical register: "    << g_stall_no_preg << endl;
+	if ((g_num_pregs[RC_INT] > 0) || (g_num_pregs[RC_FP] > 0))
+		out << "Physical registers: integer: " << g_num_pregs[RC_INT] << " FP: " << g_num_pregs[RC_FP] << endl;
+	if (g_fe_enabled) {
+		out << "Front-end stall cycles: "                 << g_fe_stall_cycles << endl;
+		if (!g_uc.empty())
+			out << "Uop cache hits: " << g_uc_hits << " misses: " << g_uc_misses
+			          << " hit rate: " << ((g_uc_hits + g_uc_misses > 0)? (double) g_uc_hits / (g_uc_hits + g_uc_misses) : 0.0) << endl;
+	}
+	out << "CDB conflict cycles: " << g_cdb_conflicts
+	          << " cycles results waited for a CDB: " << g_cdb_wait_cycles
+	          << " (policy: " << g_params.cdb_policy << ")" << endl;
+	if (g_fu_out_buf > 0)
+		out << "FU output buffers: " << g_fu_out_buf << " back-pressure unit-cycles: " << g_fu_backpressure << endl;
+	if (g_num_clusters > 1) {
+		out << "Clusters: " << g_num_clusters << " steering: " << g_params.cluster_steer
+		          << " bypass delay: " << g_cluster_bypass << endl;
+		for (UINT32 c = 0; c < g_num_clusters; c++)
+			out << "Cluster " << c << ": uops steered: " << g_cluster_steered[c]
+			          << " average RS occupancy: " << ((cycles > 0)? (double) g_cluster_occupancy[c] / cycles : 0.0) << endl;
+		out << "Operands bypassed across clusters: " << g_cluster_cross << " of " << g_cluster_wakeups
+		          << " (" << ((g_cluster_wakeups > 0)? 100.0 * g_cluster_cross / g_cluster_wakeups : 0.0) << "%)" << endl;
+	}
+	if (g_dataflow) {
+		out << "Dataflow critical path (cycles): " << g_cycle << endl;
+		out << "Dataflow window: ";
+		if (g_df_retire.empty())
+			out << "unlimited" << endl;
+		else
+			out << g_df_retire.size() << endl;
+	}
+	if (g_fusion)
+		out << "Fused cmp/test+jcc: " << g_fused_macro << " load+op: " << g_fused_load_op << endl;
+	if ((g_sched_depth > 0) || g_spec_wakeup) {
+		UINT64 replays = g_replay_miss + g_replay_chain + g_replay_late;
+		out << "Scheduler-to-execute depth: " << g_sched_depth
+		          << " speculative wakeup: " << (g_spec_wakeup? "on" : "off") << endl;
+		out << "Replayed issues: " << replays << " (load miss: " << g_replay_miss
+		          << " replayed source: " << g_replay_chain << " late CDB: " << g_replay_late << ")"
+		          << " wasted issue slots: " << ((g_issued > 0)? 100.0 * replays / g_issued : 0.0) << "%" << endl;
+	}
+	if (g_params.load_miss_pct > 0)
+		out << "Loads: " << g_loads << " misses: " << g_load_misses << " miss latency: " << g_params.load_miss_lat << endl;
+	if (g_pipeview != NULL)
+		out << "Pipeline log: " << g_params.pipeview << " uops logged: " << g_pv_logged << endl;
 }
 
 
 
-void debug_reservation_stations(){
+// Debugging aids, called from the commented-out code of the stages (hence unused)
+__attribute__((unused)) void debug_reservation_stations(){
 	cout << "########### RESERVATION STATIONS ########### " << endl; 
 	cout << "Cycle : " << g_cycle << endl; 
 	for (int i = MEMOP; i < LAST_FU; i++) {
@@ -392,7 +1083,7 @@ void debug_reservation_stations(){
 	return;
 }
 
-void debug_queue(std::priority_queue<EventQ_Item *, std::vector<EventQ_Item *>, EventQ_cmp> queue) {
+__attribute__((unused)) void debug_queue(std::priority_queue<EventQ_Item *, std::vector<EventQ_Item *>, EventQ_cmp> queue) {
 		
 		cout << "########### PRIORITY QUEUE ########### " << endl;
 		cout << "Cycle : " << g_cycle << endl;
@@ -404,13 +1095,10 @@ void debug_queue(std::priority_queue<EventQ_Item *, std::vector<EventQ_Item *>,
 			
 			cout << "Top item found: " << endl;
 					
-			ReservationStation *dres;
-			list<ReservationStation*>::iterator itPool = ev_item->rsfu->rs_pool.begin();
-			advance(itPool,ev_item->res_station);
-			dres = *(itPool);
+			ReservationStation *dres = ev_item->rs;
 
 			cout << "Res Found: " << endl ; 	
-			cout << "dst: " << dres->dstReg << " src1: " << dres->src1 << " src2: " << dres->src2 << " at station: " << ev_item->res_station << " Cycle: " << ev_item->dueCycle;
+			cout << "dst: " << dres->dstReg << " src1: " << dres->src1 << " src2: " << dres->src2 << " Cycle: " << ev_item->dueCycle;
 			cout << endl;
 			queue.pop();	
 		}
@@ -418,12 +1106,295 @@ void debug_queue(std::priority_queue<EventQ_Item *, std::vector<EventQ_Item *>,
 		return;
 }
 
-void sim_uop (CPU_OPCODE_enum opCode,  // The instruction opcode
+// The type of functional unit executing opCode
+inline UINT32 fu_type_of(CPU_OPCODE_enum opCode)
+{
+	if ((opCode == LOAD) || (opCode == STORE))
+		return MEMOP; // bundle LOAD/STORE instructions to the same functional unit (MEMOP)
+	return opCode;
+}
+
+// The physical register class of the result of opCode in register dst
+inline UINT32 reg_class_of(CPU_OPCODE_enum opCode, UINT32 dst)
+{
+	if ((dst < g_reg_class.size()) && (g_reg_class[dst] != RC_LAST))
+		return g_reg_class[dst];
+	return ((opCode == FALU) || (opCode == FMUL) || (opCode == FDIV))? RC_FP : RC_INT;
+}
+
+inline ReservationStation *producer_of(UINT32 tid, UINT32 src);
+
+// Choose the cluster of an instruction of type fu_type with sources src1, src2.
+//   Returns g_num_clusters if every cluster which could take it is full.
+UINT32 steer_cluster(UINT32 tid, UINT32 fu_type, UINT32 src1, UINT32 src2)
+{
+	ResStationFuncUnit *rsfu = rs_fu[fu_type];
+	if (g_cluster_steer == STEER_DEP) {  // Follow the producer of a source, to avoid the bypass delay
+		ReservationStation *producer = (src1 != 0)? producer_of(tid, src1) : NULL;
+		if ((producer == NULL) && (src2 != 0))
+			producer = producer_of(tid, src2);
+		if ((producer != NULL) && (producer->cluster < rsfu->num_clusters)
+		&& (rsfu->rs_per_cluster[producer->cluster] < rsfu->rs_cluster_share[producer->cluster]))
+			return producer->cluster;
+	}
+	// Balance (and dep without an in-flight producer): the least occupied cluster with room
+	UINT32 best = g_num_clusters;
+	for (UINT32 c = 0; c < rsfu->num_clusters; c++) {
+		if (rsfu->rs_per_cluster[c] >= rsfu->rs_cluster_share[c])
+			continue;
+		if ((best == g_num_clusters) || (g_cluster_rs[c] < g_cluster_rs[best]))
+			best = c;
+	}
+	return best;
+}
+
+// Check whether an instruction of thread tid can dispatch in this cycle.
+//   Returns STALL_NONE, or the reason it cannot. cluster is set to the cluster it is steered to.
+template<class CORE>
+DISPATCH_STALL can_dispatch(UINT32 tid, CPU_OPCODE_enum opCode, UINT32 src1, UINT32 src2, UINT32 dst, UINT32 &cluster)
+{
+	UINT32 fu_type = fu_type_of(opCode);
+	ResStationFuncUnit *rsfu = rs_fu[fu_type];
+
+	cluster = 0;
+	if (rsfu->rs_pool.size() == CORE::num_rs(fu_type))
+		return STALL_RS_FULL;
+	if (g_num_clusters > 1) {
+		cluster = steer_cluster(tid, fu_type, src1, src2);
+		if (cluster == g_num_clusters)
+			return STALL_RS_FULL;
+	}
+	if (g_smt_rs_part == SMT_RS_STATIC) {  // Each thread may only fill its share of the pool
+		UINT32 share = rsfu->num_rs / g_num_threads;
+		if (share == 0)
+			share = 1;
+		if (rsfu->rs_per_thread[tid] >= share)
+			return STALL_RS_FULL;
+	}
+	if ((opCode != STORE) && (dst != 0)) {
+		UINT32 rc = reg_class_of(opCode, dst);
+		if ((g_num_pregs[rc] > 0) && g_free_pregs[rc].empty())
+			return STALL_NO_PREG;
+	}
+	return STALL_NONE;
+}
+
+// The RS producing source register src of thread tid, NULL if its value is available.
+//   Registers not below num_regs, which only the unchecked per-uop entry points let
+//   through (sim_feed() rejects them), are never renamed.
+inline ReservationStation *producer_of(UINT32 tid, UINT32 src)
+{
+	if (src >= g_reg_slot.size())
+		return NULL;
+	UINT32 slot = g_reg_slot[src];
+	return (slot == 0)? NULL : registerStatus[tid][slot];
+}
+
+// The rename table slot of register reg, assigned the first time reg is written
+//   (slot 0, which is never read, for a register not below num_regs)
+inline UINT32 reg_slot_of(UINT32 reg)
+{
+	if (reg >= g_reg_slot.size())
+		return 0;
+	UINT32 slot = g_reg_slot[reg];
+	if (slot == 0) {
+		slot = registerStatus[0].size();
+		g_reg_slot[reg] = slot;
+		for (UINT32 t = 0; t < registerStatus.size(); t++)
+			registerStatus[t].push_back(NULL);
+	}
+	return slot;
+}
+
+// Place an instruction of thread tid in a reservation station and rename its destination
+template<class CORE>
+void dispatch_uop(UINT32 tid,
+		CPU_OPCODE_enum opCode,
+		UINT32 src1,
+		UINT32 src2,
+		UINT32 src3,
+		UINT32 dst,
+		UINT32 cluster)   // chosen by can_dispatch()
+{
+	UINT32 fu_type = fu_type_of(opCode);
+
+	if (CORE::verbose() == 1) {
+//		cout << "----------------Before Dispatch----------------- " << endl;
+//		debug_reservation_stations();
+//		debug_queue(g_eventQ);
+	}
+
+	ReservationStation *res = new ReservationStation(opCode,dst,NULL,NULL,NULL,tid);
+	res->seq = g_seq++;
+	res->dispatch_cycle = g_cycle;
+	res->srcReg1 = src1;
+	res->srcReg2 = src2;
+	res->srcReg3 = src3;
+	res->stall        = g_uop_stall[tid];
+	res->stall_cycles = g_uop_stall_cycles[tid];
+	g_uop_stall[tid] = STALL_NONE;
+	g_uop_stall_cycles[tid] = 0;
+	if (g_sched_depth > 0)   // Selected in the next cycle at the earliest
+		res->ready_cycle = g_cycle + 1 + g_sched_depth;
+	if ((opCode == LOAD) && (g_params.load_miss_pct > 0)) {
+		g_load_miss_acc += g_params.load_miss_pct;
+		if (g_load_miss_acc >= 100) {
+			g_load_miss_acc -= 100;
+			res->load_miss = true;
+		}
+		if (g_warmUpSim == 0) {
+			g_loads++;
+			if (res->load_miss)
+				g_load_misses++;
+		}
+	}
+	if (g_event_hook != NULL)
+		g_event_hook(g_cycle, 'D', res->seq, g_event_ctx);
+
+	switch(opCode){
+
+		case STORE: // In case of store there is no dst register!!
+			{
+				if(src1 != 0){
+					if(producer_of(tid, src1)!=NULL){
+						res->set_src1(producer_of(tid, src1));
+					}
+				}
+				if(src2 != 0){ 
+					if(producer_of(tid, src2)!=NULL){
+						res->set_src2(producer_of(tid, src2));
+					}
+				}
+				if(src3 != 0){
+					if(producer_of(tid, src3)!=NULL){
+						res->set_src3(producer_of(tid, src3));
+					}
+				}
+				//cout << "STORE Instruction" << endl;
+			}
+
+		default:
+			{
+
+				if(src1 != 0){
+					if(producer_of(tid, src1)!=NULL){
+						res->set_src1(producer_of(tid, src1));
+					}
+				}
+				if(src2 != 0){
+					if(producer_of(tid, src2)!=NULL){
+						res->set_src2(producer_of(tid, src2));
+					}
+				}
+				if (dst != 0) {
+					res->dstSlot = reg_slot_of(dst);
+					registerStatus[tid][res->dstSlot] = res; // Update the registerStatus[dst] -- it points to the last ReservationStation
+				}
+			}
+
+	}
+	if ((opCode != STORE) && (dst != 0)) {  // Rename the result to a free physical register
+		UINT32 rc = reg_class_of(opCode, dst);
+		if (g_num_pregs[rc] > 0) {
+			res->preg = g_free_pregs[rc].back();
+			g_free_pregs[rc].pop_back();
+		}
+	}
+	rs_fu[fu_type]->rs_pool.push_back(res);
+	rs_fu[fu_type]->rs_per_thread[tid]++;
+	res->cluster = cluster;
+	rs_fu[fu_type]->rs_per_cluster[cluster]++;
+	g_cluster_rs[cluster]++;
+	if (g_warmUpSim == 0)
+		g_cluster_steered[cluster]++;
+	g_thread_icount[tid]++;
+	if (g_warmUpSim == 0) {
+		g_instructions_dispatched++;
+		g_thread_dispatched[tid]++;
+	}
+
+	if (CORE::verbose() == 0) {
+//		cout << "----------------After Dispatch----------------- " << endl;
+//		debug_reservation_stations();
+//		debug_queue(g_eventQ);
+	}
+}
+
+// Move the clock to the next cycle and run the back-end stages.
+//   Sets g_sim_finished when the detailed simulation cycles are exhausted;
+//   the caller is responsible for ending the simulation.
+template<class CORE>
+void advance_cycle()
+{
+	g_cycle++;  // count the cycle
+	if (g_warmUpSim > 0) {  // Keep track of warm-up cycles
+		g_warmUpSim--;
+		if (g_warmUpSim == 0) {
+			g_cycle_start = g_cycle;   // Keep the cycle when warm-up finishes.
+			///////////////////////////////////////////////////////////////////////////////////////////
+			// IMPORTANT: (g_cycle-g_cycle_start) is the total number of cycles for calculating IPC etc.
+			///////////////////////////////////////////////////////////////////////////////////////////
+			g_last = g_cycle;  // for keep-alive print-outs, if enabled
+			std::cout <<"SIM: ------- Warm-up phase ended --------" << std::endl; 
+		}
+	}
+	// Run pipe stages in reverse order
+	//  so as not to propagate an instruction through all stages in a single cycle!
+	// Result forwarding works because the WriteResult stage "wakes-up" dependent instructions
+	//  which will start execution in the same cycle
+	run_WriteResult_stage<CORE>();
+	if (CORE::verbose() == 1) {
+//	cout << "--------Before Execute-------- " << endl;
+//	debug_queue(g_eventQ);
+	}
+	run_Execute_stage<CORE>();
+	if (CORE::verbose() == 1) {
+//	cout << "--------After Execute--------- " <<endl;
+//	debug_queue(g_eventQ);
+	}
+	if (g_detailedSim < (g_cycle - g_cycle_start)) { // Check for end of simulation
+		__atomic_store_n(&g_sim_finished, true, __ATOMIC_RELEASE);
+	}
+	if (g_cycle == g_telemetry_next)
+		telemetry_publish(false);
+	if ((g_num_clusters > 1) && (g_warmUpSim == 0)) {
+		for (UINT32 c = 0; c < g_num_clusters; c++)
+			g_cluster_occupancy[c] += g_cluster_rs[c];
+	}
+	if (CORE::verbose() >= 1) {
+		// Print something to show simulation is alive
+		if (g_cycle - g_last == 100000000) {
+			std::cout <<"SIM: cycle: " << g_cycle << std::endl; 
+			g_last = g_cycle;
+		}
+	}
+}
+
+// End the simulation once advance_cycle() has set g_sim_finished: publish the final
+//   statistics and hand over to the finish callback, which may end the process. Runs once.
+void sim_exit()
+{
+	if (g_sim_exited)
+		return;
+	g_sim_exited = true;
+	if (g_telemetry != NULL)
+		telemetry_publish(true);
+	if (g_pipeview != NULL)   // The finish callback may end the process
+		pipeview_flush();
+	if (g_finish_fn != NULL)
+		g_finish_fn(&g_core, g_finish_ctx);
+}
+
+template<class CORE>
+void sim_uop_t (UINT32 uop_opcode,       // The instruction opcode (CPU_OPCODE_enum)
 		UINT32 src1,             // source register 1
 		UINT32 src2,             // source register 2
 		UINT32 src3,             // source register 3
 		UINT32 dst)              // destination register
 {
+	CPU_OPCODE_enum opCode = (CPU_OPCODE_enum) uop_opcode;
+	if (g_sim_finished)   // The detailed cycles are exhausted: nothing more to simulate
+		return;
 	if (g_fastFwdSim > 0) {  // We are in fast-forward simulation, update f-fwd instruction count only
 		g_fastFwdSim--;
 		if (g_fastFwdSim == 0)
@@ -435,165 +1406,423 @@ void sim_uop (CPU_OPCODE_enum opCode,  // The instruction opcode
 		
 		instruction_can_dispatch = true;
 		/* ------------------------ This is the DISPATCH stage ----------------------- */
-		UINT32 fu_type;
-		if ((opCode == LOAD) || (opCode == STORE))
-			fu_type = MEMOP; // bundle LOAD/STORE instructions to the same functional unit (MEMOP)
-		else
-			fu_type = opCode;
+		UINT32 fu_type = fu_type_of(opCode);
 		
-		if(rs_fu[fu_type]->rs_pool.size() ==  rs_fu[fu_type]->num_rs){
+		UINT32 cluster;
+		DISPATCH_STALL stall = can_dispatch<CORE>(0, opCode, src1, src2, dst, cluster);
+		if (stall != STALL_NONE) {
 			instruction_can_dispatch = false;
 		}
 
 
 		// For debugging:
-		if (Knob_verbose.Value() == 1) {
+		if (CORE::verbose() == 1) {
 			std::cout << "At: " << g_cycle
 				<< " Dispatching instruction: " << opcode2String(opCode)
-				<< " dst:"  << REG_StringShort( (REG) dst)  << " " << dst
-				<< " src1:" << REG_StringShort( (REG) src1) << " " << src1
-				<< " src2:" << REG_StringShort( (REG) src2) << " " << src2
-				<< " src3:" << REG_StringShort( (REG) src3) << " " << src3
+				<< " dst:"  << dst
+				<< " src1:" << src1
+				<< " src2:" << src2
+				<< " src3:" << src3
 				<< " Can dispatch " << instruction_can_dispatch
 				<< std::endl;
 		}
-		// --------------------------------------------------------------------------
-		// --------------------------------------------------------------------------
-		// Write code to check if instruction can dispatch.
-		//   if it cannot dispatch, set variable instruction_can_dispatch = false
-		// --------------------------------------------------------------------------
-		// --------------------------------------------------------------------------
-
-		// End of "can dispatch" code
-		// --------------------------------------------------------------------------
 		// For debugging:
-		if (Knob_verbose.Value() >= 2) {
+		if (CORE::verbose() >= 2) {
 			std::cout << " rsPoolsz: " << rs_fu[fu_type]->rs_pool.size() 
-				<< " numRs: "    << rs_fu[fu_type]->num_rs
+				<< " numRs: "    << CORE::num_rs(fu_type)
 				<< " dispatch "  << instruction_can_dispatch
 				<< std::endl;
 		}
 		if (instruction_can_dispatch) {
-			// ------------------------------------------------------------------------
-			// ------------------------------------------------------------------------
-			// Dispatch the instruction------------------------------------------------
-			// ------------------------------------------------------------------------
-			// ------------------------------------------------------------------------
-			// v
-				if (Knob_verbose.Value() == 1) {
-//					cout << "----------------Before Dispatch----------------- " << endl;
-//					debug_reservation_stations();
-//					debug_queue(g_eventQ);
-				}
-		
-			ReservationStation *res = new ReservationStation(opCode,dst,NULL,NULL,NULL);
-
-			switch(opCode){
-
-				case STORE: // In case of store there is no dst register!!
-					{
-						if(src1 != 0){
-							if(registerStatus[src1]!=NULL){
-								res->set_src1(registerStatus[src1]);				  	
-							}
-						}
-						if(src2 != 0){ 
-							if(registerStatus[src2]!=NULL){
-								res->set_src2(registerStatus[src2]);				  	
-							}
-						}
-						if(src3 != 0){
-							if(registerStatus[src3]!=NULL){
-								res->set_src3(registerStatus[src3]);				  	
-							}
-						}
-						//cout << "STORE Instruction" << endl;
-					}
-
-				default:
-					{
-
-						if(src1 != 0){
-							if(registerStatus[src1]!=NULL){
-								res->set_src1(registerStatus[src1]);				  	
-							}
-						}
-						if(src2 != 0){
-							if(registerStatus[src2]!=NULL){
-								res->set_src2(registerStatus[src2]);				  	
-							}
-						}
-						registerStatus[dst] = res; // Update the registerStatus[dst] -- it points to the last ReservationStation
-					}
-
-			}
-			rs_fu[fu_type]->rs_pool.push_back(res);
-			
-			if (Knob_verbose.Value() == 0) {
-//					cout << "----------------After Dispatch----------------- " << endl;
-//					debug_reservation_stations();
-//					debug_queue(g_eventQ);
-				}
-		
-
-			// End of dispatch
+			dispatch_uop<CORE>(0, opCode, src1, src2, src3, dst, cluster);
 
 			// Count number of instructions dispatched in this clock cycle
 			g_dispatch_count++;
-			if (g_dispatch_count == Knob_disp_width.Value()) {
+			if (g_dispatch_count == CORE::disp_width()) {
 				g_is_new_cycle = true;
 				g_dispatch_count = 0;
 			}
 		} else { // Issue is stalled. Move on to the next cycle
+			g_uop_stall[0] = stall;
+			g_uop_stall_cycles[0]++;
+			if ((g_dispatch_count == 0) && (g_warmUpSim == 0)) {
+				g_thread_stalls[0]++;
+				if (stall == STALL_RS_FULL)
+					g_stall_rs_full++;
+				else
+					g_stall_no_preg++;
+			}
 			g_is_new_cycle = true;
 			g_dispatch_count = 0;
 		}
 
 		if (g_is_new_cycle) {
 			g_is_new_cycle = false;
-			g_cycle++;  // count the cycle
-			if (g_warmUpSim > 0) {  // Keep track of warm-up cycles
-				g_warmUpSim--;
-				if (g_warmUpSim == 0) {
-					g_cycle_start = g_cycle;   // Keep the cycle when warm-up finishes.
-					///////////////////////////////////////////////////////////////////////////////////////////
-					// IMPORTANT: (g_cycle-g_cycle_start) is the total number of cycles for calculating IPC etc.
-					///////////////////////////////////////////////////////////////////////////////////////////
-					g_last = g_cycle;  // for keep-alive print-outs, if enabled
-					std::cout <<"SIM: ------- Warm-up phase ended --------" << std::endl; 
-				}
-			}
-			// Run pipe stages in reverse order
-			//  so as not to propagate an instruction through all stages in a single cycle!
-			// Result forwarding works because the WriteResult stage "wakes-up" dependent instructions
-			//  which will start execution in the same cycle
-			run_WriteResult_stage();
-			if (Knob_verbose.Value() == 1) {
-//			cout << "--------Before Execute-------- " << endl;
-//			debug_queue(g_eventQ);
+			advance_cycle<CORE>();
+			if (g_sim_finished) {
+				sim_exit();
+				return;
 			}
-			run_Execute_stage();
-			if (Knob_verbose.Value() == 1) {
-//			cout << "--------After Execute--------- " <<endl;
-//			debug_queue(g_eventQ);
-			}
-			if (g_detailedSim < (g_cycle - g_cycle_start)) { // Check for end of simulation
-				print_stats();
-				TraceFile.close();
-				PIN_ExitProcess(0);   // end the simulation
+		}
+
+	} while (!instruction_can_dispatch);
+}
+
+// Advance the clock until every dispatched instruction has written its result
+template<class CORE>
+void sim_drain_t()
+{
+	bool busy = true;
+	while (busy && !g_sim_finished) {
+		busy = !g_eventQ.empty() || !g_cdb_waiting.empty();
+		for (int i = MEMOP; i < LAST_FU; i++)
+			busy = busy || !rs_fu[i]->rs_pool.empty();
+		if (busy)
+			advance_cycle<CORE>();
+	}
+	if (g_sim_finished)
+		sim_exit();
+}
+
+// Let cycles clock cycles pass without dispatching: the current cycle ends with the
+//   uops dispatched so far
+template<class CORE>
+void sim_advance_t(UINT64 cycles)
+{
+	g_is_new_cycle = false;
+	g_dispatch_count = 0;
+	for (UINT64 c = 0; (c < cycles) && !g_sim_finished; c++)
+		advance_cycle<CORE>();
+	if (g_sim_finished)
+		sim_exit();
+}
+
+// The cycle the latest value of register reg is produced. Registers not below num_regs,
+//   which only the unchecked per-uop entry points let through, are always ready.
+inline UINT64 df_ready_of(UINT32 reg)
+{
+	return (reg < g_df_ready.size())? g_df_ready[reg] : 0;
+}
+
+// DATAFLOW core: the earliest completion of a uop is the latest completion of its sources
+//   plus the latency of its FU, with unlimited FUs, dispatch width and CDBs. With a window
+//   of W uops it also cannot start before the uop W older retires. O(1) per uop.
+// The sources are those the cycle core waits for: a STORE reads src1-src3, other uops src1, src2.
+void sim_uop_dataflow(UINT32 uop_opcode, UINT32 src1, UINT32 src2, UINT32 src3, UINT32 dst)
+{
+	CPU_OPCODE_enum opCode = (CPU_OPCODE_enum) uop_opcode;
+	if (g_sim_finished)
+		return;
+	if (g_fastFwdSim > 0) {
+		g_fastFwdSim--;
+		if (g_fastFwdSim == 0)
+			std::cout <<"SIM: ------- Fast-forward phase ended --------" << std::endl; 
+		return;
+	}
+	UINT64 start = std::max(df_ready_of(src1), df_ready_of(src2));
+	if (opCode == STORE)
+		start = std::max(start, df_ready_of(src3));
+	if (!g_df_retire.empty())   // Wait for a free window entry
+		start = std::max(start, g_df_retire[g_df_next]);
+	UINT64 done = start + rs_fu[fu_type_of(opCode)]->latency;
+
+	if ((opCode != STORE) && (dst != 0) && (dst < g_df_ready.size()))
+		g_df_ready[dst] = done;
+	g_df_last_retire = std::max(g_df_last_retire, done);
+	if (!g_df_retire.empty()) {
+		g_df_retire[g_df_next] = g_df_last_retire;
+		g_df_next = (g_df_next + 1 == g_df_retire.size())? 0 : g_df_next + 1;
+	}
+	g_instructions_dispatched++;
+	g_instructions_wb++;
+	if (done > g_cycle) {
+		g_cycle = done;
+		if (g_cycle >= g_telemetry_next)   // The critical path jumps: it may pass the update cycle
+			telemetry_publish(false);
+		if (g_detailedSim < g_cycle) {
+			g_sim_finished = true;
+			sim_exit();
+		}
+	}
+}
+
+// Every uop of the dataflow core is complete as soon as it is simulated
+void sim_drain_dataflow()
+{
+}
+
+// The dataflow core has no clock: idle cycles do not change the critical path
+void sim_advance_dataflow(UINT64)
+{
+}
+
+// Look up the instruction at pc in the uop cache, allocating it (LRU) on a miss.
+//   Returns true on a hit.
+bool uop_cache_access(UINT64 pc)
+{
+	// Sets are indexed by the 32-byte code window, as in the decoded ICaches of x86 cores
+	UopCacheEntry *set = &g_uc[((pc >> 5) & g_uc_set_mask) * g_uc_ways];
+	UopCacheEntry *victim = &set[0];
+	g_uc_tick++;
+	for (UINT32 w = 0; w < g_uc_ways; w++) {
+		if (set[w].valid && (set[w].tag == pc)) {
+			set[w].last_use = g_uc_tick;
+			return true;
+		}
+		if (!set[w].valid || (victim->valid && (set[w].last_use < victim->last_use)))
+			victim = &set[w];
+	}
+	victim->tag      = pc;
+	victim->last_use = g_uc_tick;
+	victim->valid    = true;
+	return false;
+}
+
+// The front-end has run out of bandwidth in this cycle: the uops still to come wait for the next one
+template<class CORE>
+void fe_stall()
+{
+	if (g_warmUpSim == 0)
+		g_fe_stall_cycles++;
+	g_uop_stall[0] = STALL_FRONTEND;
+	g_uop_stall_cycles[0]++;
+	g_is_new_cycle = false;
+	g_dispatch_count = 0;
+	advance_cycle<CORE>();
+	if (g_sim_finished)
+		sim_exit();   // sim_fetch_t() stops
+	g_fe_cycle = g_cycle;
+	g_fe_bytes = 0;
+	g_fe_slots = 0;
+}
+
+// FRONT-END: fetch and decode the macro-instruction at pc, of size bytes, before its uops
+//   are passed to sim_uop(). slots is the number of decode slots it needs (its uops, less the
+//   fused ones); fused holds FUSION_enum flags. size includes a conditional branch fused with it.
+// Fetch and dispatch are not decoupled by a queue: the front-end supplies the uops dispatched
+//   in the current cycle and ends the cycle early when its fetch or decode bandwidth runs out.
+template<class CORE>
+void sim_fetch_t(UINT64 pc, UINT32 size, UINT32 slots, UINT32 fused)
+{
+	if ((g_fastFwdSim > 0) || g_sim_finished)   // Fast-forward counts uops only, in sim_uop()
+		return;
+	if (g_warmUpSim == 0) {
+		if (fused & FUSED_MACRO)
+			g_fused_macro++;
+		if (fused & FUSED_LOAD_OP)
+			g_fused_load_op++;
+	}
+	if (!g_fe_enabled)
+		return;
+	if (g_fe_cycle != g_cycle) {   // sim_uop() has moved to a new cycle
+		g_fe_cycle = g_cycle;
+		g_fe_bytes = 0;
+		g_fe_slots = 0;
+	}
+	if (!g_uc.empty() && uop_cache_access(pc)) {   // Decoded uops come from the uop cache
+		if (g_warmUpSim == 0)
+			g_uc_hits++;
+		return;
+	}
+	if (!g_uc.empty() && (g_warmUpSim == 0))
+		g_uc_misses++;
+
+	UINT32 fetch_bytes  = g_cfg.fetch_bytes;
+	UINT32 decode_width = g_cfg.decode_width;
+	bool fits = ((fetch_bytes == 0)  || (g_fe_bytes + size  <= fetch_bytes))
+	         && ((decode_width == 0) || (g_fe_slots + slots <= decode_width));
+	// An instruction which needs more than a whole cycle starts on an empty one
+	if (!fits && ((g_fe_bytes > 0) || (g_fe_slots > 0)))
+		fe_stall<CORE>();
+	// and takes as many fetch cycles as its bytes need
+	while ((fetch_bytes > 0) && (g_fe_bytes + size > fetch_bytes) && !g_sim_finished) {
+		size -= fetch_bytes - g_fe_bytes;
+		fe_stall<CORE>();
+	}
+	g_fe_bytes += size;
+	g_fe_slots += slots;
+}
+
+// Pick the thread whose next uop gets the current dispatch slot.
+//   Returns g_num_threads if no thread has a uop which can still dispatch in this cycle.
+UINT32 smt_select_thread()
+{
+	UINT32 selected = g_num_threads;
+	for (UINT32 k = 0; k < g_num_threads; k++) {
+		UINT32 t = (g_smt_rr_next + k) % g_num_threads;
+		if ((g_smt_blocked[t] != STALL_NONE) || (g_smt_queues[t]->front() == NULL))
+			continue;
+		if (g_smt_fetch == SMT_FETCH_RR) {
+			selected = t;
+			break;
+		}
+		// ICOUNT: prefer the thread with the fewest instructions waiting in the RS pools
+		if ((selected == g_num_threads) || (g_thread_icount[t] < g_thread_icount[selected]))
+			selected = t;
+	}
+	if ((g_smt_fetch == SMT_FETCH_RR) && (selected != g_num_threads))
+		g_smt_rr_next = (selected + 1) % g_num_threads;
+	return selected;
+}
+
+// Simulate one clock cycle of the SMT core: fill the dispatch slots from the per-thread
+//   uop queues according to the fetch policy, then run the back-end stages.
+// Only the simulation thread calls this, so the shared core structures need no locks.
+// Returns false, without advancing the clock, when no thread has a uop queued.
+bool sim_smt_cycle()
+{
+	bool any_queued = false;
+	for (UINT32 t = 0; t < g_num_threads; t++) {
+		g_smt_waiting[t]    = (g_smt_queues[t]->front() != NULL);
+		g_smt_blocked[t]    = STALL_NONE;
+		g_smt_dispatched[t] = 0;
+		any_queued = any_queued || g_smt_waiting[t];
+	}
+	if (!any_queued)
+		return false;
+
+	if (g_fastFwdSim > 0) {  // Fast-forward: consume instructions of all threads without simulating them
+		for (UINT32 t = 0; (t < g_num_threads) && (g_fastFwdSim > 0); t++) {
+			if (g_smt_waiting[t]) {
+				g_smt_queues[t]->pop();
+				g_fastFwdSim--;
+				if (g_fastFwdSim == 0)
+					std::cout <<"SIM: ------- Fast-forward phase ended --------" << std::endl; 
 			}
-			if (Knob_verbose.Value() >= 1) {
-				// Print something to show simulation is alive
-				if (g_cycle - g_last == 100000000) {
-					std::cout <<"SIM: cycle: " << g_cycle << std::endl; 
-					g_last = g_cycle;
-				}
+		}
+		return true;
+	}
+
+	/* ------------------------ This is the DISPATCH stage ----------------------- */
+	while (g_dispatch_count < GenericCore::disp_width()) {
+		UINT32 tid = smt_select_thread();
+		if (tid == g_num_threads)
+			break;
+		SmtUop *uop = g_smt_queues[tid]->front();
+		UINT32 cluster;
+		g_smt_blocked[tid] = can_dispatch<GenericCore>(tid, (CPU_OPCODE_enum) uop->opCode, uop->src1, uop->src2, uop->dst, cluster);
+		if (g_smt_blocked[tid] != STALL_NONE)   // in-order per thread: nothing else from it this cycle
+			continue;
+		dispatch_uop<GenericCore>(tid, (CPU_OPCODE_enum) uop->opCode, uop->src1, uop->src2, uop->src3, uop->dst, cluster);
+		g_smt_queues[tid]->pop();
+		g_smt_dispatched[tid]++;
+		g_dispatch_count++;
+	}
+	for (UINT32 t = 0; t < g_num_threads; t++)
+		if (g_smt_blocked[t] != STALL_NONE) {   // Its next uop waits for another cycle
+			g_uop_stall[t] = g_smt_blocked[t];
+			g_uop_stall_cycles[t]++;
+		}
+	if (g_warmUpSim == 0) {
+		for (UINT32 t = 0; t < g_num_threads; t++)
+			if (g_smt_waiting[t] && (g_smt_dispatched[t] == 0)) {
+				g_thread_stalls[t]++;
+				if (g_smt_blocked[t] == STALL_RS_FULL)
+					g_stall_rs_full++;
+				else if (g_smt_blocked[t] == STALL_NO_PREG)
+					g_stall_no_preg++;
 			}
+	}
+	g_dispatch_count = 0;
+
+	advance_cycle<GenericCore>();
+	if (g_sim_finished)
+		sim_exit();
+	return true;
+}
+
+// With speculative wakeup: whether consumer may issue although its source src has not been
+//   written on the CDB, because src issued long enough ago for its predicted result to be there.
+//   The result is late, so the issue is replayed (see replay_issue()).
+inline bool spec_ready(const ReservationStation *consumer, const ReservationStation *src)
+{
+	if (src == NULL)
+		return true;
+	UINT64 wakeup = src->wakeup_cycle + ((src->cluster != consumer->cluster)? g_cluster_bypass : 0);
+	if (src->to_be_executed)
+		return wakeup <= g_cycle;
+	// src was replayed itself: its dependents selected before the cancel reached the
+	//   scheduler issue, and are replayed too
+	return (src->replays > 0) && (wakeup <= g_cycle) && (g_cycle < src->cancel_cycle + g_sched_depth);
+}
+
+// rs has issued to unit of rsfu before its operands arrived: the issue slot is lost, and rs
+//   waits for its sources on the CDB from now on (it is not woken speculatively again).
+// The replay is signalled when the missing operand is detected, at the execution of the first
+//   instruction of the dependence chain; the rest of the chain inherits the signal.
+void replay_issue(ReservationStation *rs, ResStationFuncUnit *rsfu, UINT32 unit)
+{
+	bool miss = false, chain = false;
+	rs->cancel_cycle = g_cycle;
+	ReservationStation *srcs[3] = { rs->src1, rs->src2, rs->src3 };
+	for (int s = 0; s < 3; s++) {
+		if (srcs[s] == NULL)
+			continue;
+		miss = miss || (srcs[s]->to_be_executed && srcs[s]->load_miss);
+		if (!srcs[s]->to_be_executed) {
+			chain = true;
+			rs->cancel_cycle = std::min(rs->cancel_cycle, srcs[s]->cancel_cycle);
 		}
+	}
+	rsfu->last_init[unit] = g_cycle;
+	rs->replays++;
+	rs->wakeup_cycle = g_cycle + rsfu->latency;   // Its own dependents may have been woken
+	if (g_warmUpSim == 0) {
+		if (miss)
+			g_replay_miss++;
+		else if (chain)
+			g_replay_chain++;
+		else
+			g_replay_late++;
+		g_issued++;
+	}
+	if (g_event_hook != NULL)
+		g_event_hook(g_cycle, 'R', rs->seq, g_event_ctx);
+}
 
-	} while (!instruction_can_dispatch);
+// Start the execution of rs_p on unit ii of FU type i
+template<class CORE>
+inline void issue(ReservationStation *rs_p, UINT32 i, UINT32 ii)
+{
+	UINT64 due = g_cycle + rs_fu[i]->latency;
+	if (rs_p->load_miss)
+		due += g_params.load_miss_lat;
+	rs_fu[i]->ops_in_progress[ii]++;
+	rs_fu[i]->last_init[ii] = g_cycle;
+	g_eventQ.push(new EventQ_Item(due,rs_fu[i],rs_p,ii));
+//		debug_queue(g_eventQ);
+	rs_p->to_be_executed = true;
+	rs_p->issue_cycle = g_cycle;
+	rs_p->fu_num = ii;
+	rs_p->wakeup_cycle = g_cycle + rs_fu[i]->latency;   // Loads are predicted to hit
+	if (g_warmUpSim == 0)
+		g_issued++;
+	if (g_event_hook != NULL)
+		g_event_hook(g_cycle, 'E', rs_p->seq, g_event_ctx);
 }
 
+// Selection for unit ii of FU type i with speculative wakeup: the oldest instruction of the unit's
+//   cluster whose sources are on the CDB, or predicted to be, issues (and is replayed if they are not)
+template<class CORE>
+void select_speculative(UINT32 i, UINT32 ii, UINT32 unit_cluster)
+{
+	for (std::list<ReservationStation*>::iterator it = rs_fu[i]->rs_pool.begin(); it != rs_fu[i]->rs_pool.end(); it++) {
+		ReservationStation *rs_p = *it;
+		if ((rs_p->cluster != unit_cluster) || rs_p->to_be_executed || (rs_p->ready_cycle > g_cycle))
+			continue;
+		if ((rs_p->src1 == NULL) && (rs_p->src2 == NULL) && (rs_p->src3 == NULL)) {
+			issue<CORE>(rs_p, i, ii);
+			return;
+		}
+		if ((rs_p->replays == 0) && spec_ready(rs_p, rs_p->src1) && spec_ready(rs_p, rs_p->src2)
+		&& spec_ready(rs_p, rs_p->src3)) {
+			replay_issue(rs_p, rs_fu[i], ii);
+			return;
+		}
+	}
+}
+
+template<class CORE>
 void run_Execute_stage()
 {
 
@@ -607,7 +1836,7 @@ void run_Execute_stage()
 	// ---------------------------------------------------------------------------------------------------------------
 	bool execute = true;
 	for (int i = MEMOP; i < LAST_FU; i++) {  // For all types of FUs
-		for (UINT32 ii = 0; ii < rs_fu[i]->num_fus; ii++) {  // For each FU of type i
+		for (UINT32 ii = 0; ii < CORE::num_fus(i); ii++) {  // For each FU of type i
 			// For debugging:
 			execute = true;
 
@@ -618,8 +1847,14 @@ void run_Execute_stage()
 			if((rs_fu[i]->ops_in_progress[ii]) == rs_fu[i]->pipe_depth){
 				execute = false;
 			}
+
+			if ((g_fu_out_buf > 0) && (rs_fu[i]->out_buf[ii] == g_fu_out_buf)) {  // Back-pressure from the CDB
+				if (execute && (g_warmUpSim == 0))
+					g_fu_backpressure++;
+				execute = false;
+			}
 		
-			if (Knob_verbose.Value() >= 3) {
+			if (CORE::verbose() >= 3) {
 				std::cout << "At: "                  << g_cycle
 					<< " FU type: "            << opcode2String((CPU_OPCODE_enum) i) 
 					<< " FU num: " << ii
@@ -638,9 +1873,11 @@ void run_Execute_stage()
 
 			// End of "unit can execute" code
 			// -----------------------------------------------------------
-			if(execute){
-				int res_from_pool = 0; // pass info to EventQ
-				for (std::list<ReservationStation*>::iterator it = rs_fu[i]->rs_pool.begin(); it != rs_fu[i]->rs_pool.end(); it++) {
+			UINT32 unit_cluster = ii % g_num_clusters;
+			if (execute && g_spec_wakeup)
+				select_speculative<CORE>(i, ii, unit_cluster);
+			else if(execute){
+						for (std::list<ReservationStation*>::iterator it = rs_fu[i]->rs_pool.begin(); it != rs_fu[i]->rs_pool.end(); it++) {
 				// -------------------------------------------------------------
 				// Look from oldest to newest entries in the reservation station
 				//  for instructions ready to execute
@@ -653,7 +1890,7 @@ void run_Execute_stage()
 				// -------------------------------------------------------------
 					ReservationStation *rs_p = *it;
 				// For debugging:
-					if (Knob_verbose.Value() >= 3) {
+					if (CORE::verbose() >= 3) {
 						std::cout << "At: " << g_cycle
 							<< " FUtype: " << opcode2String((CPU_OPCODE_enum) i) << " FUnum:" << ii
 							<< " sources: " << rs_p->src1 << ", " << rs_p->src2 << ", " << rs_p->src3;
@@ -664,18 +1901,15 @@ void run_Execute_stage()
 				// -----------------------------------------------------------------------------
 				// -----------------------------------------------------------------------------
 				 	//if(i == MEMOP && rs_p != *(rs_fu[i]->rs_pool.begin())) break;
-					if( rs_p->src1 == NULL && rs_p->src2 == NULL  && rs_p->src3 == NULL && rs_p->to_be_executed == false ){
-//						cout << "Inserted in Queue " << " Pool: " <<  res_from_pool << " fu_number: " << ii <<  endl; 
-						rs_fu[i]->ops_in_progress[ii]++;
-						rs_fu[i]->last_init[ii] = g_cycle;
-						g_eventQ.push(new EventQ_Item(g_cycle+rs_fu[i]->latency,rs_fu[i],res_from_pool,ii));
-					//		debug_queue(g_eventQ);
-						rs_p->to_be_executed = true;
+					if (rs_p->cluster != unit_cluster)   // Units only execute the RS of their cluster
+						continue;
+					if( rs_p->src1 == NULL && rs_p->src2 == NULL  && rs_p->src3 == NULL && rs_p->to_be_executed == false
+					&& rs_p->ready_cycle <= g_cycle ){
+						issue<CORE>(rs_p, i, ii);
 						break;
 					}
 				// End of code for execution initiation
 				// -----------------------------------------------------------------------------
-					res_from_pool++;
 				}  // endforeach reservation station
 			}
 		} // endforeach FU
@@ -685,10 +1919,156 @@ void run_Execute_stage()
 
 
 
+// A result written on the CDB reaches a consumer in another cluster g_cluster_bypass cycles later
+inline void cluster_bypass(ReservationStation *consumer, ReservationStation *producer)
+{
+	bool cross = (consumer->cluster != producer->cluster);
+	if (cross)
+		consumer->ready_cycle = std::max(consumer->ready_cycle, g_cycle + g_cluster_bypass);
+	if (g_warmUpSim == 0) {
+		g_cluster_wakeups++;
+		if (cross)
+			g_cluster_cross++;
+	}
+}
+
+// A result written on the CDB wakes consumer, which is selected and reaches execution
+//   g_sched_depth cycles later - unless it was woken speculatively and the result is on time
+inline void sched_wakeup(ReservationStation *consumer, ReservationStation *producer)
+{
+	if (g_spec_wakeup && (consumer->replays == 0) && (g_cycle <= producer->wakeup_cycle))
+		return;
+	consumer->ready_cycle = std::max(consumer->ready_cycle, g_cycle + g_sched_depth);
+}
+
+// Broadcast the result of ev_item on a CDB: wake up its dependents, release its RS, physical
+//   register and FU slot, and delete the event and the RS.
+template<class CORE>
+void write_result(EventQ_Item *ev_item)
+{
+	ReservationStation *dres = ev_item->rs;
+	if (g_event_hook != NULL)
+		g_event_hook(g_cycle, 'W', dres->seq, g_event_ctx);
+
+	list<ReservationStation*>::iterator itPool = std::find(ev_item->rsfu->rs_pool.begin(), ev_item->rsfu->rs_pool.end(), dres);
+	if (ev_item->buffered)   // The result waited in the FU's output buffer, not in its pipeline
+		ev_item->rsfu->out_buf[ev_item->fu_num]--;
+	else
+		ev_item->rsfu->ops_in_progress[ev_item->fu_num]--;
+	ev_item->rsfu->rs_per_thread[dres->tid]--;
+	ev_item->rsfu->rs_per_cluster[dres->cluster]--;
+	g_cluster_rs[dres->cluster]--;
+	g_thread_icount[dres->tid]--;
+	if (g_warmUpSim == 0) {
+		g_instructions_wb++;
+		g_thread_wb[dres->tid]++;
+		g_cdb_wait_cycles += g_cycle - ev_item->dueCycle;
+	}
+
+	//cout << ev_item ->rsfu->fu_type << endl; 
+	// Consumers get the result late across clusters and through the scheduling loop
+	bool wake_delay = (g_num_clusters > 1) || (g_sched_depth > 0);
+	for (int i = MEMOP; i < LAST_FU; i++) { 
+		for (std::list<ReservationStation*>::iterator it = rs_fu[i]->rs_pool.begin(); it != rs_fu[i]->rs_pool.end(); it++){
+				ReservationStation *rs_p = *it;
+				if (wake_delay && ((rs_p->src1 == dres) || (rs_p->src2 == dres) || (rs_p->src3 == dres))) {
+					if (g_num_clusters > 1)
+						cluster_bypass(rs_p, dres);
+					if (g_sched_depth > 0)
+						sched_wakeup(rs_p, dres);
+				}
+				if(rs_p->src1 == dres){ 
+					//cout << "Solved Dependency" << endl;  
+					rs_p->src1 = NULL; }
+				if(rs_p->src2 == dres){ 
+					//cout << "Solved Dependency" << endl; 
+					rs_p->src2 = NULL;}
+				if(rs_p->src3 == dres){ 
+					//cout << "Solved Dependency" << endl; 
+					rs_p->src3 = NULL;}
+				
+		}
+
+	}
+	
+	// The register now holds the value, unless a younger instruction has renamed it again
+	if ((dres->dstSlot != 0) && (registerStatus[dres->tid][dres->dstSlot] == dres))
+		registerStatus[dres->tid][dres->dstSlot] = NULL;
+	if (dres->preg != PREG_NONE)   // Free the physical register
+		g_free_pregs[reg_class_of(dres->opCode, dres->dstReg)].push_back(dres->preg);
+//	cout << "Going to delete" << endl;
+	if (g_pipeview != NULL)
+		pipeview_record(dres, ev_item->dueCycle);
+	ev_item->rsfu->rs_pool.erase(itPool);
+//	cout<< "Deleted" << endl;
+	delete ev_item;
+	delete dres;
+}
+
+// CDB arbitration order: true if result a gets a bus before result b
+struct CdbPriority {
+	bool operator()(const EventQ_Item *a, const EventQ_Item *b) const {
+		switch (g_cdb_policy) {
+			case CDB_DUE:   // Results which have waited longest first
+				if (a->dueCycle != b->dueCycle)
+					return a->dueCycle < b->dueCycle;
+				break;
+			case CDB_FU:
+				if (g_cdb_fu_rank[a->rsfu->fu_type] != g_cdb_fu_rank[b->rsfu->fu_type])
+					return g_cdb_fu_rank[a->rsfu->fu_type] < g_cdb_fu_rank[b->rsfu->fu_type];
+				break;
+			case CDB_LATENCY:
+				if (a->rsfu->latency != b->rsfu->latency)
+					return a->rsfu->latency > b->rsfu->latency;
+				break;
+			default:
+				break;
+		}
+		return a->rs->seq < b->rs->seq;   // oldest first
+	}
+};
+
+// Explicit CDB arbitration (any -cdb_policy but due, or output buffers): every due result
+//   competes for the buses, the losers wait in g_cdb_waiting - in their FU's output buffer
+//   if it has room, otherwise in the FU pipeline, which then backs up into Execute.
+template<class CORE>
+void arbitrate_cdb()
+{
+	while (!g_eventQ.empty() && (g_eventQ.top()->dueCycle <= g_cycle)) {
+		g_cdb_waiting.push_back(g_eventQ.top());
+		g_eventQ.pop();
+	}
+	UINT32 buses = CORE::cdb_width();
+	if (g_cdb_waiting.size() > buses) {
+		if (g_warmUpSim == 0)
+			g_cdb_conflicts++;
+		std::partial_sort(g_cdb_waiting.begin(), g_cdb_waiting.begin() + buses, g_cdb_waiting.end(), CdbPriority());
+	} else
+		buses = g_cdb_waiting.size();
+	for (UINT32 b = 0; b < buses; b++)
+		write_result<CORE>(g_cdb_waiting[b]);
+	g_cdb_waiting.erase(g_cdb_waiting.begin(), g_cdb_waiting.begin() + buses);
+
+	for (UINT32 w = 0; w < g_cdb_waiting.size(); w++) {
+		EventQ_Item *ev_item = g_cdb_waiting[w];
+		ResStationFuncUnit *rsfu = ev_item->rsfu;
+		if (!ev_item->buffered && (rsfu->out_buf[ev_item->fu_num] < g_fu_out_buf)) {  // Leave the pipeline
+			ev_item->buffered = true;
+			rsfu->out_buf[ev_item->fu_num]++;
+			rsfu->ops_in_progress[ev_item->fu_num]--;
+		}
+	}
+}
+
+template<class CORE>
 void run_WriteResult_stage()
 {
 	/* --------------------- This is the WRITE_RESULT stage ------------------- */
-	for (UINT32 cdb_count = 0; cdb_count < Knob_cdb_width.Value(); cdb_count++) {   // For each common data bus (result bus
+	if (g_cdb_arbitrate) {
+		arbitrate_cdb<CORE>();
+		return;
+	}
+	for (UINT32 cdb_count = 0; cdb_count < CORE::cdb_width(); cdb_count++) {   // For each common data bus (result bus
 		// Check if a result is due on this cycle.
 		//   e.g. use g_eventQ.empty(), g_eventQ.top()
 		// If there is:
@@ -697,7 +2077,7 @@ void run_WriteResult_stage()
 		//       remove the RS object from the rs_pool of the appropriate ResStationFuncUnit and delete the RS object.
 
 		// For debugging:
-		if (Knob_verbose.Value() >= 4) {
+		if (CORE::verbose() >= 4) {
 			std::cout << "At: " << g_cycle
 				<< " WB: " ;
 		}
@@ -711,45 +2091,285 @@ void run_WriteResult_stage()
 //			cout <<  "Not yet" << endl;
 			break;
 		}
-		ReservationStation *dres;
-
-		list<ReservationStation*>::iterator itPool = ev_item->rsfu->rs_pool.begin();
-		advance(itPool,ev_item->res_station);
-		dres = *(itPool);
-		ev_item->rsfu->ops_in_progress[ev_item->fu_num]--;
-
-		//cout << ev_item ->rsfu->fu_type << endl; 
-		for (int i = MEMOP; i < LAST_FU; i++) { 
-			for (std::list<ReservationStation*>::iterator it = rs_fu[i]->rs_pool.begin(); it != rs_fu[i]->rs_pool.end(); it++){
-					ReservationStation *rs_p = *it;
-					if(rs_p->src1 == dres){ 
-						//cout << "Solved Dependency" << endl;  
-						rs_p->src1 = NULL; }
-					if(rs_p->src2 == dres){ 
-						//cout << "Solved Dependency" << endl; 
-						rs_p->src2 = NULL;}
-					if(rs_p->src3 == dres){ 
-						//cout << "Solved Dependency" << endl; 
-						rs_p->src3 = NULL;}
-					
-			}
-	
-		}
-		
-		for(int i=0; i< REG_LAST ; i++){
-			if( registerStatus[i] == dres ){
-//				cout << "Dependency of register: " << i << endl ; 
-				registerStatus[i]=NULL;
-			}
-		}
-//		cout << "Going to delete" << endl;
-		ev_item->rsfu->rs_pool.erase(itPool);
-//		cout<< "Deleted" << endl;
 		g_eventQ.pop();
-		free(ev_item);
-		free(dres);
+		write_result<CORE>(ev_item);
 		// End of result write handling
 		// -------------------------------------------------------------
 	} // endfor cdb_count
+	// More results due than buses: the rest wait in their FU pipelines
+	if (!g_eventQ.empty() && (g_eventQ.top()->dueCycle <= g_cycle) && (g_warmUpSim == 0))
+		g_cdb_conflicts++;
 	return;
 }
+
+
+
+// -------------------------------------------------------------------------------
+// ---------------------------------- C API --------------------------------------
+// -------------------------------------------------------------------------------
+// See sim_api.h. The handle is g_core; the parameters are kept in g_params.
+
+// The parameters of sim_params.def, for sim_config_default() and sim_config_set()
+enum PARAM_TYPE { PT_U32, PT_U64, PT_BOOL, PT_STR };
+struct ParamInfo {
+	const char *name;      // Switch name
+	PARAM_TYPE  type;
+	size_t      offset;    // Of the field in sim_config
+	const char *def;       // Default value
+};
+#define SIM_PARAM(type, field, name, def, desc) { name, PT_##type, offsetof(sim_config, field), def },
+const ParamInfo g_param_info[] = {
+#include "sim_params.def"
+};
+#undef SIM_PARAM
+
+// Store value in the field of parameter p. Returns false if it is not a valid value.
+bool param_parse(sim_config *cfg, const ParamInfo &p, const char *value)
+{
+	char *field = (char *) cfg + p.offset;
+	char *end;
+	switch (p.type) {
+		case PT_U32:   // "-1" is 0xffffffff, as in Pin
+			*(uint32_t *) field = (uint32_t) strtoul(value, &end, 0);
+			return (end != value) && (*end == '\0');
+		case PT_U64:
+			*(uint64_t *) field = strtoull(value, &end, 0);
+			return (end != value) && (*end == '\0');
+		case PT_BOOL:
+			if ((strcmp(value, "1") != 0) && (strcmp(value, "true") != 0)
+			&& (strcmp(value, "0") != 0) && (strcmp(value, "false") != 0))
+				return false;
+			*(uint32_t *) field = (strcmp(value, "1") == 0) || (strcmp(value, "true") == 0);
+			return true;
+		default:
+			if (strlen(value) >= SIM_STR_MAX)
+				return false;
+			strcpy(field, value);
+			return true;
+	}
+}
+
+}  // namespace
+
+void sim_config_default(sim_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->api_version = SIM_API_VERSION;
+	cfg->num_regs    = 1024;
+	for (UINT32 p = 0; p < sizeof(g_param_info) / sizeof(g_param_info[0]); p++)
+		param_parse(cfg, g_param_info[p], g_param_info[p].def);
+}
+
+int sim_config_set(sim_config *cfg, const char *name, const char *value)
+{
+	for (UINT32 p = 0; p < sizeof(g_param_info) / sizeof(g_param_info[0]); p++)
+		if (strcmp(g_param_info[p].name, name) == 0)
+			return param_parse(cfg, g_param_info[p], value)? 0 : -1;
+	return -1;
+}
+
+uint32_t sim_api_version(void)
+{
+	return SIM_API_VERSION;
+}
+
+sim_core *sim_create(const sim_config *cfg)
+{
+	if (g_core.created) {
+		sim_error("a core already exists in this process");
+		return NULL;
+	}
+	if (cfg->api_version != SIM_API_VERSION) {
+		sim_error("sim_config of another API version");
+		return NULL;
+	}
+	g_params = *cfg;
+	g_event_hook = NULL;
+	g_finish_fn  = NULL;
+	if (!sim_init()) {
+		sim_fini();
+		return NULL;
+	}
+	g_core.created = true;
+	return &g_core;
+}
+
+const char *sim_last_error(void)
+{
+	return g_sim_error.c_str();
+}
+
+void sim_destroy(sim_core *core)
+{
+	if (!valid_core(core))
+		return;
+	if ((g_telemetry != NULL) && !g_sim_exited)   // Readers see the final statistics
+		telemetry_publish(true);
+	sim_fini();
+	g_event_hook = NULL;
+	g_finish_fn  = NULL;
+	g_core.created = false;
+}
+
+uint64_t sim_feed(sim_core *core, const sim_uop_rec *uops, uint64_t n)
+{
+	if (!valid_core(core))
+		return 0;
+	SIM_UOP_FUNC sim_uop = g_sim_uop;
+	uint64_t i;
+	for (i = 0; (i < n) && !g_sim_finished; i++) {
+		if (!valid_uop(uops[i]))
+			break;
+		sim_uop(uops[i].opcode, uops[i].src1, uops[i].src2, uops[i].src3, uops[i].dst);
+	}
+	return i;
+}
+
+void sim_fetch(sim_core *core, uint64_t pc, uint32_t size, uint32_t slots, uint32_t fused)
+{
+	if (!valid_core(core))
+		return;
+	g_sim_fetch(pc, size, slots, fused);
+}
+
+void sim_advance(sim_core *core, uint64_t cycles)
+{
+	if (!valid_core(core))
+		return;
+	g_sim_advance(cycles);
+}
+
+void sim_drain(sim_core *core)
+{
+	if (!valid_core(core))
+		return;
+	g_sim_drain();
+}
+
+int sim_finished(const sim_core *core)
+{
+	if (!valid_core(core))
+		return 1;
+	return __atomic_load_n(&g_sim_finished, __ATOMIC_ACQUIRE);
+}
+
+void sim_set_finish_callback(sim_core *core, sim_finish_fn fn, void *ctx)
+{
+	if (!valid_core(core))
+		return;
+	g_finish_fn  = fn;
+	g_finish_ctx = ctx;
+}
+
+int sim_set_reg_class(sim_core *core, uint32_t reg, uint32_t reg_class)
+{
+	if (!valid_core(core))
+		return 0;
+	if ((reg >= g_reg_class.size()) || (reg_class > SIM_REG_FP)) {
+		sim_error("invalid register or register class");
+		return 0;
+	}
+	g_reg_class[reg] = (reg_class == SIM_REG_INT)? RC_INT : (reg_class == SIM_REG_FP)? RC_FP : RC_LAST;
+	return 1;
+}
+
+void sim_set_event_hook(sim_core *core, sim_event_fn fn, void *ctx)
+{
+	if (!valid_core(core))
+		return;
+	g_event_hook = fn;
+	g_event_ctx  = ctx;
+}
+
+sim_uop_fn sim_uop_function(sim_core *core)
+{
+	if (!valid_core(core))
+		return NULL;
+	return g_sim_uop;
+}
+
+sim_fetch_fn sim_fetch_function(sim_core *core)
+{
+	if (!valid_core(core))
+		return NULL;
+	return ((g_fe_enabled || g_fusion) && g_smt_queues.empty())? g_sim_fetch : NULL;
+}
+
+uint32_t sim_smt_threads(const sim_core *core)
+{
+	if (!valid_core(core))
+		return 0;
+	return g_smt_queues.size();
+}
+
+int sim_smt_push(sim_core *core, uint32_t tid, const sim_uop_rec *uop)
+{
+	if (!valid_core(core) || !valid_uop(*uop))
+		return 0;
+	if (tid >= g_smt_queues.size()) {
+		sim_error("no such SMT thread context");
+		return 0;
+	}
+	SmtUop smt_uop = { uop->opcode, uop->src1, uop->src2, uop->src3, uop->dst };
+	return g_smt_queues[tid]->push(smt_uop);
+}
+
+int sim_smt_cycle(sim_core *core)
+{
+	if (!valid_core(core))
+		return 0;
+	return sim_smt_cycle();
+}
+
+void sim_get_stats(const sim_core *core, sim_stats *stats)
+{
+	if (!valid_core(core)) {
+		memset(stats, 0, sizeof(*stats));
+		stats->core = "invalid";
+		return;
+	}
+	UINT64 cycles = g_cycle - g_cycle_start;
+	stats->cycles          = g_cycle;
+	stats->measured_cycles = cycles;
+	stats->uops_dispatched = g_instructions_dispatched;
+	stats->uops_wb         = g_instructions_wb;
+	stats->ipc             = (cycles > 0)? (double) g_instructions_wb / cycles : 0.0;
+	stats->stall_rs_full   = g_stall_rs_full;
+	stats->stall_no_preg   = g_stall_no_preg;
+	stats->stall_frontend  = g_fe_stall_cycles;
+	stats->cdb_conflicts   = g_cdb_conflicts;
+	stats->replays         = g_replay_miss + g_replay_chain + g_replay_late;
+	stats->host_seconds    = host_seconds();
+	stats->core            = g_core_name;
+	stats->finished        = sim_finished(core);
+}
+
+size_t sim_format_stats(const sim_core *core, char *buf, size_t size)
+{
+	std::ostringstream out;
+	if (valid_core(core))
+		print_stats(out);
+	string text = out.str();
+	if (size > 0) {
+		size_t len = std::min(text.size(), size - 1);
+		memcpy(buf, text.data(), len);
+		buf[len] = '\0';
+	}
+	return text.size();
+}
+
+const char *sim_opcode_name(uint32_t opcode)
+{
+	switch(opcode) {
+		case MEMOP:  return "MEMOP";
+		case LOAD:  return "LOAD";
+		case STORE: return "STORE";
+		case IALU:  return "IALU";
+		case IMUL:  return "IMUL";
+		case IDIV:  return "IDIV";
+		case FALU:  return "FALU";
+		case FMUL:  return "FMUL";
+		case FDIV:  return "FDIV";
+		default:    return "INVALID";
+	}
+}